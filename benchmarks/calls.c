@@ -0,0 +1,269 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+// Cost of logging calls in nanoseconds per call. Every case is run in rounds of
+// the same number of iterations and median and 99th percentile of mean call cost
+// in rounds are reported. Individual calls are too short to be timed separately
+// and thus the percentile describes variance between rounds, not tail latency of
+// calls. Results can be written as JSON to compare them across commits.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <logc.h>
+
+LOG(off)
+LOG(unconfigured)
+LOG(chain1)
+LOG(chain2)
+LOG(chain3)
+LOG(leaf)
+LOG(plain)
+LOG(def)
+LOG(full)
+LOG(multi)
+LOG(sys)
+
+#define MULTI_OUTPUTS 4
+
+// Syslog is replaced so benchmark does not depend on system logger. Message is
+// still formatted as real syslog would do it.
+void vsyslog(int priority, const char *format, va_list args) {
+	char buf[BUFSIZ];
+	vsnprintf(buf, sizeof buf, format, args);
+	__asm__ volatile ("" : : "r"(buf) : "memory");
+}
+
+void syslog(int priority, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	vsyslog(priority, format, args);
+	va_end(args);
+}
+
+void __syslog_chk(int priority, int flag, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	vsyslog(priority, format, args);
+	va_end(args);
+}
+
+
+static void disabled_configured(long n) {
+	for (long i = 0; i < n; i++)
+		log_debug(log_off, "benchmark message %ld", i);
+}
+
+static void disabled_unconfigured(long n) {
+	for (long i = 0; i < n; i++)
+		log_debug(log_unconfigured, "benchmark message %ld", i);
+}
+
+static void disabled_bound(long n) {
+	for (long i = 0; i < n; i++)
+		log_debug(log_leaf, "benchmark message %ld", i);
+}
+
+static void enabled_plain(long n) {
+	for (long i = 0; i < n; i++)
+		log_notice(log_plain, "benchmark message %ld", i);
+}
+
+static void enabled_default(long n) {
+	for (long i = 0; i < n; i++)
+		log_notice(log_def, "benchmark message %ld", i);
+}
+
+static void enabled_full(long n) {
+	for (long i = 0; i < n; i++)
+		log_notice(log_full, "benchmark message %ld", i);
+}
+
+static void multiple_outputs(long n) {
+	for (long i = 0; i < n; i++)
+		log_notice(log_multi, "benchmark message %ld", i);
+}
+
+static void syslog_output(long n) {
+	for (long i = 0; i < n; i++)
+		log_notice(log_sys, "benchmark message %ld", i);
+}
+
+static void would_log(long n) {
+	unsigned cnt = 0;
+	for (long i = 0; i < n; i++)
+		cnt += log_would_log(log_off, LL_DEBUG);
+	__asm__ volatile ("" : : "r"(cnt));
+}
+
+static const struct {
+	const char *name;
+	void (*run)(long n);
+} cases[] = {
+	{"disabled_configured", disabled_configured},
+	{"disabled_unconfigured", disabled_unconfigured},
+	{"disabled_bound3", disabled_bound},
+	{"enabled_plain", enabled_plain},
+	{"enabled_default", enabled_default},
+	{"enabled_full", enabled_full},
+	{"multiple_outputs", multiple_outputs},
+	{"syslog", syslog_output},
+	{"would_log", would_log},
+};
+#define CASES_CNT (sizeof cases / sizeof *cases)
+
+struct result {
+	bool measured;
+	long iterations;
+	double median, p99, min; // of round means
+};
+
+
+static FILE *devnull(log_t log, const char *format) {
+	FILE *f = fopen("/dev/null", "w");
+	if (f == NULL) {
+		perror("/dev/null");
+		exit(1);
+	}
+	log_add_output(log, f, 0, 0, format);
+	return f;
+}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double round_ns(void (*run)(long), long n) {
+	double start = now();
+	run(n);
+	return now() - start;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double da = *(const double *)a, db = *(const double *)b;
+	return (da > db) - (da < db);
+}
+
+// Iterations are doubled until round takes at least given time unless they are
+// fixed. Single warm up round precedes measured ones.
+static void measure(void (*run)(long), long iterations, double min_round_ns,
+		unsigned rounds, struct result *res) {
+	if (iterations <= 0)
+		for (iterations = 16; round_ns(run, iterations) < min_round_ns; iterations *= 2);
+	run(iterations);
+	double *samples = malloc(rounds * sizeof *samples);
+	for (unsigned r = 0; r < rounds; r++)
+		samples[r] = round_ns(run, iterations) / iterations;
+	qsort(samples, rounds, sizeof *samples, cmp_double);
+	res->measured = true;
+	res->iterations = iterations;
+	res->min = samples[0];
+	res->median = rounds % 2 ? samples[rounds / 2] :
+		(samples[rounds / 2 - 1] + samples[rounds / 2]) / 2;
+	// Nearest rank percentile
+	res->p99 = samples[(99 * rounds + 99) / 100 - 1];
+	free(samples);
+}
+
+static void write_json(FILE *f, unsigned rounds, const struct result *results) {
+	fprintf(f, "{\n\t\"benchmark\": \"calls\",\n\t\"unit\": \"ns/call\",\n"
+			"\t\"rounds\": %u,\n\t\"results\": [\n", rounds);
+	const char *sep = "";
+	for (size_t i = 0; i < CASES_CNT; i++) {
+		if (!results[i].measured)
+			continue;
+		fprintf(f, "%s\t\t{\"name\": \"%s\", \"iterations\": %ld, \"median\": %.2f, "
+				"\"p99_round_means\": %.2f, \"min\": %.2f}", sep, cases[i].name,
+				results[i].iterations, results[i].median, results[i].p99,
+				results[i].min);
+		sep = ",\n";
+	}
+	fprintf(f, "\n\t]\n}\n");
+}
+
+static void usage(const char *argv0) {
+	fprintf(stderr, "Usage: %s [-n ITERATIONS] [-r ROUNDS] [-t MIN_ROUND_US] "
+			"[-o JSON] [CASE...]\n", argv0);
+}
+
+int main(int argc, char **argv) {
+	long iterations = 0;
+	unsigned rounds = 100;
+	double min_round_ns = 1e6;
+	const char *json = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:r:t:o:h")) != -1) {
+		switch (opt) {
+			case 'n':
+				iterations = atol(optarg);
+				break;
+			case 'r':
+				rounds = atoi(optarg);
+				break;
+			case 't':
+				min_round_ns = atof(optarg) * 1000;
+				break;
+			case 'o':
+				json = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (rounds == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	// Configured log has its own cached threshold while unconfigured one
+	// (log_unconfigured) uses the shared default
+	log_set_level(log_off, 0);
+	log_bind(log_chain1, log_chain2);
+	log_bind(log_chain2, log_chain3);
+	log_bind(log_chain3, log_leaf);
+	FILE *files[3 + MULTI_OUTPUTS];
+	files[0] = devnull(log_plain, LOG_FORMAT_PLAIN);
+	files[1] = devnull(log_def, LOG_FORMAT_DEFAULT);
+	files[2] = devnull(log_full, LOG_FORMAT_FULL);
+	for (int i = 0; i < MULTI_OUTPUTS; i++)
+		files[3 + i] = devnull(log_multi, LOG_FORMAT_DEFAULT);
+	log_syslog_format(log_sys, LOG_FORMAT_PLAIN);
+	log_stderr_fallback(log_sys, false);
+
+	struct result results[CASES_CNT] = {};
+	printf("%-22s %12s %10s %18s %10s\n", "case", "iterations", "median",
+			"p99 of round means", "min");
+	for (size_t i = 0; i < CASES_CNT; i++) {
+		bool selected = optind == argc;
+		for (int a = optind; a < argc; a++)
+			selected |= !strcmp(argv[a], cases[i].name);
+		if (!selected)
+			continue;
+		measure(cases[i].run, iterations, min_round_ns, rounds, &results[i]);
+		printf("%-22s %12ld %10.2f %18.2f %10.2f\n", cases[i].name,
+				results[i].iterations, results[i].median, results[i].p99,
+				results[i].min);
+	}
+
+	if (json) {
+		FILE *f = fopen(json, "w");
+		if (f == NULL) {
+			perror(json);
+			return 1;
+		}
+		write_json(f, rounds, results);
+		fclose(f);
+	}
+
+	log_t logs[] = {log_off, log_unconfigured, log_chain1, log_chain2, log_chain3, log_leaf,
+		log_plain, log_def, log_full, log_multi, log_sys};
+	for (size_t i = 0; i < sizeof logs / sizeof *logs; i++)
+		log_free(logs[i]);
+	for (size_t i = 0; i < sizeof files / sizeof *files; i++)
+		fclose(files[i]);
+	return 0;
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+// Throughput of output backends: lines are logged to temporary file from single
+// thread as fast as possible and rate is reported for every backend.
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <logc.h>
+
+LOG(bench)
+
+static const struct {
+	const char *name;
+	int flags;
+} backends[] = {
+	{"stdio", 0},
+	{"async", LOG_F_ASYNC},
+	{"io_uring", LOG_F_IO_URING},
+	{"buffer", LOG_F_BUFFER},
+};
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+	long lines = argc > 1 ? atol(argv[1]) : 200000;
+	log_stderr_fallback(log_bench, false);
+	for (size_t i = 0; i < sizeof backends / sizeof *backends; i++) {
+		char path[] = "/tmp/logc-bench-XXXXXX";
+		int fd = mkstemp(path);
+		if (fd == -1) {
+			perror("mkstemp");
+			return 1;
+		}
+		unlink(path);
+		FILE *f = fdopen(fd, "a");
+		log_add_output(log_bench, f, backends[i].flags, 0, LOG_FORMAT_DEFAULT);
+
+		double start = now();
+		for (long l = 0; l < lines; l++)
+			log_notice(log_bench, "benchmark line %ld with some payload %s", l,
+					backends[i].name);
+		log_flush(log_bench);
+		double elapsed = now() - start;
+
+		log_rm_output(log_bench, f);
+		fclose(f);
+		printf("%-10s %10.0f lines/s\n", backends[i].name, lines / elapsed);
+	}
+	log_free(log_bench);
+	return 0;
+}
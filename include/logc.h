@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdint.h>
 
 enum log_message_level {
 	LL_TRACE = -3,
@@ -24,6 +25,21 @@ struct log {
 };
 typedef struct log* log_t;
 
+// This is the initial part of private log data used by inline verbosity check.
+// Never ever access or modify it directly!
+// Threshold is packed to single word so it is loaded atomically on any platform:
+// level offset from LL_TRACE (clamped to LL_CRITICAL + 1), flight recorder flag
+// and generation in the remaining bits.
+struct _log_threshold {
+	unsigned value;
+};
+#define _LOGC_THRESHOLD_LEVEL 0x7U
+#define _LOGC_THRESHOLD_RECORDER 0x8U
+#define _LOGC_THRESHOLD_GENERATION_SHIFT 4
+extern unsigned _logc_generation;
+// Threshold of logs that were never configured
+extern struct _log_threshold _logc_default_threshold;
+
 #define APP_LOG(logname) \
 	struct log _log_ ## logname = (struct log){.name = NULL, ._log = NULL, .daemon = false }; \
 	log_t log_ ## logname = &_log_ ## logname;
@@ -48,7 +64,8 @@ void log_offset_level(log_t, int offset) __attribute__((nonnull));
 // Check verbosity level to check if output would be used for given level.
 // This should be used when message requires significant processing before logc is
 // called.
-// Returns true if message would be outputed and false if not.
+// Returns true if message would be outputed (or recorded by flight recorder) and
+// false if not.
 bool log_would_log(log_t, enum log_message_level);
 
 //// Additional options //////////////////////////////////////////////////////////
@@ -57,6 +74,38 @@ bool log_would_log(log_t, enum log_message_level);
 bool log_use_origin(log_t) __attribute__((nonnull));
 void log_set_use_origin(log_t, bool) __attribute__((nonnull));
 
+// Mechanism used to protect output from signal handlers that log as well.
+// This is global setting common to all logs.
+enum log_signal_safety {
+	// Messages from signal handlers that interrupted logging in the same thread are
+	// postponed and outputted once interrupted logging is finished. Critical
+	// messages are never postponed.
+	LOG_SIG_DEFER,
+	// All signals are blocked for the whole time messages is being outputted.
+	LOG_SIG_MASK,
+	// All signals are blocked only when line is being written to output.
+	LOG_SIG_MASK_WRITE,
+};
+enum log_signal_safety log_signal_safety();
+void log_set_signal_safety(enum log_signal_safety);
+
+// Clock used for time fields of format (such as %Ti or %Tm).
+// This is global setting common to all logs.
+enum log_clock {
+	// Precise system clocks (CLOCK_REALTIME and CLOCK_MONOTONIC).
+	LOG_CLOCK_REALTIME,
+	// Coarse system clocks. They are faster to read but their resolution is only
+	// in milliseconds.
+	LOG_CLOCK_REALTIME_COARSE,
+	// Time stamp counter of processor calibrated against system clocks. This is
+	// the fastest option but it is available only on x86 with invariant TSC. Step
+	// changes of system time are reflected with delay of up to one minute.
+	LOG_CLOCK_TSC,
+};
+enum log_clock log_clock();
+// Returns false if given clock is not supported (the current one is kept).
+bool log_set_clock(enum log_clock);
+
 //// Standard format pieces free to reuse ////////////////////////////////////////
 // Color based on level of message. Conditioned to be used only when colors should
 // be used. This is intended to distinguish different message levels by colors.
@@ -91,6 +140,53 @@ void log_set_use_origin(log_t, bool) __attribute__((nonnull));
 #define LOG_F_COLORS (1 << 2)
 // Automatically close passed FILE when log_rm_output is called
 #define LOG_F_AUTOCLOSE (1 << 4)
+// Locking of output while line is being written. Lock appropriate for type of
+// output file is used if none of these is specified. If multiple are specified
+// then the one specified later here has precedence.
+// No locking at all
+#define LOG_F_LOCK_NONE (1 << 5)
+// Lock only in between threads of this process
+#define LOG_F_LOCK_MUTEX (1 << 6)
+// No locking with expectation that file is opened in append mode and thus lines
+// written in single write are not interleaved
+#define LOG_F_LOCK_APPEND (1 << 7)
+// Use flock to lock the whole file
+#define LOG_F_LOCK_FLOCK (1 << 8)
+// Use fcntl record lock on the whole file
+#define LOG_F_LOCK_FCNTL (1 << 9)
+// Write lines from separate thread. Lines are queued and the calling thread waits
+// only if queue is full.
+#define LOG_F_ASYNC (1 << 10)
+// Drop the line being logged if queue of asynchronous output is full instead of
+// waiting (implies LOG_F_ASYNC).
+#define LOG_F_ASYNC_DROP_NEWEST (1 << 11)
+// Drop the oldest queued line if queue of asynchronous output is full instead of
+// waiting (implies LOG_F_ASYNC).
+#define LOG_F_ASYNC_DROP_OLDEST (1 << 12)
+// Capture only message arguments and format message in the writer thread of
+// asynchronous output (implies LOG_F_ASYNC).
+#define LOG_F_ASYNC_DEFERRED (1 << 13)
+// Suppress consecutive identical messages (same level, log name, message and
+// error). Line "last message repeated N times" is outputted instead once
+// different message is logged or log is flushed. This is ignored for binary
+// outputs.
+#define LOG_F_DEDUP (1 << 14)
+// Write lines of asynchronous output using io_uring. Lines queued while the
+// previous write is in progress are written by the single next one. Plain write
+// is used if io_uring is not available (implies LOG_F_ASYNC). File, compressed
+// and memory mapped outputs handle it as LOG_F_ASYNC.
+#define LOG_F_IO_URING (1 << 15)
+// Buffer lines and write them once LOG_BUFFER_SIZE bytes or LOG_BUFFER_LINES
+// lines are pending. Errors and critical messages are written right away together
+// with all buffered lines. log_flush and exit write buffered lines as well.
+#define LOG_F_BUFFER (1 << 16)
+// Same as LOG_F_BUFFER but buffered lines are also written every
+// LOG_BUFFER_INTERVAL milliseconds by shared flusher thread.
+#define LOG_F_BUFFER_TIMER (1 << 17)
+
+#define LOG_BUFFER_SIZE (64 * 1024)
+#define LOG_BUFFER_LINES 256
+#define LOG_BUFFER_INTERVAL 100
 
 // Add output stream to log with specified output format.
 // Flags is ored set of LOG_F_* flags or zero.
@@ -102,6 +198,15 @@ void log_set_use_origin(log_t, bool) __attribute__((nonnull));
 //   %i:  Source line of message (in source file)
 //   %c:  Function message is raised from
 //   %e:  Standard error message (empty if errno == 0)
+//   %S:  Sampling rate of message (empty if message is not sampled)
+//   %Ti: Local date and time (ISO 8601)
+//   %Tu: UTC date and time (ISO 8601)
+//   %Tz: Offset of local time from UTC
+//   %Tr: Local date and time with microseconds and offset (RFC 3339)
+//   %Ts: Seconds since epoch
+//   %Tm: Seconds of monotonic clock
+//   %Te: Seconds since program start
+//   %T3, %T6, %T9: Fraction of second of previous time field
 //   %(_:  Start of not-empty condition. Following text till the end of condition
 //        is printed only if at least one '%*' field in it is not empty.
 //   %(C: Start of critical level of message condition.
@@ -132,6 +237,102 @@ void log_set_use_origin(log_t, bool) __attribute__((nonnull));
 void log_add_output(log_t, FILE*, int flags, int level, const char *format)
 	__attribute__((nonnull));
 
+// Add binary output stream to log. Messages are written in compact binary form
+// with formats and strings stored only once. Arguments of messages are stored
+// instead of formatted messages. Use logc-decode tool to convert it to text.
+// Flags and level have the same meaning as for log_add_output (formatting flags
+// are ignored). Output is removed with log_rm_output as any other.
+void log_add_binary_output(log_t, FILE*, int flags, int level)
+	__attribute__((nonnull));
+
+// Rotation policy of file output. File is rotated once it would exceed given size
+// (in bytes) or is older than given age (in seconds). Zero means no limit. Rotated
+// files are renamed to PATH.1 (the newest) up to PATH.KEEP. The oldest one is
+// removed.
+struct log_rotation {
+	size_t max_size;
+	unsigned max_age;
+	unsigned keep;
+};
+
+// Add output to file on given path. It is opened in append mode and created if it
+// doesn't exist. Rotation can be NULL if file should not be rotated. Flags, level
+// and format have the same meaning as for log_add_output (LOG_F_AUTOCLOSE is
+// implied).
+// Rotation and reopen are performed by the writer that first notices they are due.
+// Other writers do not wait for it.
+// Returns FILE of output that can be used to remove it with log_rm_output or NULL
+// (and sets errno) if file can't be opened.
+FILE *log_add_file_output(log_t, const char *path, int flags, int level,
+		const char *format, const struct log_rotation *rotation)
+	__attribute__((nonnull(1, 2, 5)));
+
+// Compression codec of compressed file output. Codecs are optional and
+// log_add_compressed_output fails if requested one was not compiled in.
+enum log_codec {
+	LOG_CODEC_GZIP,
+	LOG_CODEC_ZSTD,
+};
+
+// Compression of file output. Level zero selects codec's default. Compressed frame
+// is closed at least once every frame interval (in seconds) so complete frames
+// are readable even when file is not closed properly. Zero means that frame is
+// closed only by log_flush and when output is removed.
+struct log_compression {
+	enum log_codec codec;
+	int level;
+	unsigned frame_interval;
+};
+
+// Add output to compressed file on given path. It is opened in append mode and
+// created if it doesn't exist. Lines are collected and compressed in batches. Use
+// LOG_F_ASYNC to compress them in writer thread instead of logging one. Flags and
+// level have the same meaning as for log_add_output (LOG_F_AUTOCLOSE is implied).
+// Format can be NULL for binary output (see log_add_binary_output).
+// Returns FILE that identifies output for log_rm_output (it must not be written
+// to) or NULL (and sets errno) if file can't be opened or codec is not supported.
+FILE *log_add_compressed_output(log_t, const char *path, int flags, int level,
+		const char *format, const struct log_compression *compression)
+	__attribute__((nonnull(1, 2, 6)));
+
+// Memory mapped file output. File is extended by region (in bytes) when it is
+// full up to max size (in bytes). Zero selects the default (1 MiB region and 1 GiB
+// maximum). Written lines are synchronized to disk with msync at least once every
+// sync interval (in seconds, zero disables it) and by log_flush.
+struct log_mmap {
+	size_t region;
+	size_t max_size;
+	unsigned sync_interval;
+};
+
+// Add output to memory mapped file on given path. It is created if it doesn't
+// exist and lines are appended to it. Lines are copied to the mapping without any
+// lock or system call. Processes forked after output was added append to the same
+// file. Lines that do not fit to the maximum size are dropped (see
+// log_output_dropped). Flags, level and format have the same meaning as for
+// log_add_output (LOG_F_AUTOCLOSE is implied and locking flags are ignored).
+// Format can be NULL for binary output (see log_add_binary_output). Mmap can be
+// NULL for defaults.
+// Returns FILE that identifies output for log_rm_output (it must not be written
+// to) or NULL (and sets errno) if file can't be opened or mapped.
+FILE *log_add_mmap_output(log_t, const char *path, int flags, int level,
+		const char *format, const struct log_mmap *mmap)
+	__attribute__((nonnull(1, 2)));
+
+// Request reopen of all files of file outputs. They are reopened before the next
+// line is written to them. This is intended for external rotation (such as
+// logrotate) and it is async-signal-safe.
+void log_reopen_files();
+
+// Install SIGHUP handler that calls log_reopen_files. Returns false if handler
+// can't be installed.
+bool log_reopen_on_sighup();
+
+// Number of lines dropped by asynchronous output with LOG_F_ASYNC_DROP_NEWEST or
+// LOG_F_ASYNC_DROP_OLDEST policy or by memory mapped output that is full. Zero is
+// returned if there is no such output.
+size_t log_output_dropped(log_t, FILE*) __attribute__((nonnull));
+
 // Remove provided FILE from registered outputs of log. Note that this won't
 // ever trigger fclose (LOG_F_AUTOCLOSE does not apply here).
 // Returns true if output was successfully removed or false if it wasn't found.
@@ -187,20 +388,227 @@ log_t log_bound(log_t) __attribute__((nonnull));
 void log_unbind(log_t) __attribute__((nonnull));
 
 
+//// Rate limiting ///////////////////////////////////////////////////////////////
+// Rate limited message is outputted at most burst times in given interval (in
+// milliseconds). Tokens are regained continuously so after a burst single message
+// is allowed every interval/burst milliseconds. Suppressed messages are counted
+// and message "Suppressed N similar messages" is outputted right before the next
+// message that is allowed again. Messages suppressed after the last allowed one
+// are never reported (not even by log_flush or log_free).
+// The state is placed in static storage next to the message. Never modify it
+// directly!
+struct log_ratelimit {
+	unsigned burst;
+	unsigned interval;
+	unsigned long _full; // monotonic time (ms, wraps around) when bucket is full again
+	size_t _suppressed;
+};
+#define LOG_RATELIMIT_BURST 10
+#define LOG_RATELIMIT_INTERVAL 5000
+
+//// Sampling //////////////////////////////////////////////////////////////////
+// Sampling outputs only a fraction of messages. Outputted messages carry their
+// sampling rate N (one of N messages is outputted) that is available in format as
+// %S so counts can be extrapolated.
+enum log_sampling_mode {
+	// No sampling, every message is outputted.
+	LOG_SAMPLE_ALL,
+	// Every Nth message is outputted (starting with the first one).
+	LOG_SAMPLE_EVERY,
+	// Message is outputted with probability 1/N.
+	LOG_SAMPLE_RANDOM,
+	// First K messages are outputted (they are not considered sampled) and then
+	// every Nth one.
+	LOG_SAMPLE_FIRST,
+};
+// Sampling of message. The state is placed in static storage next to the message.
+// Never modify it directly!
+struct log_sampling {
+	enum log_sampling_mode mode;
+	unsigned n;
+	unsigned first; // K for LOG_SAMPLE_FIRST
+	size_t _count;
+};
+
+// Sample messages of log with level up to the given one. Messages enabled with
+// log_callsites_enable are not subject of this sampling. Use LOG_SAMPLE_ALL to
+// disable sampling.
+void log_set_sampling(log_t, int level, enum log_sampling_mode mode, unsigned n,
+		unsigned first) __attribute__((nonnull));
+
+//// Flight recorder ///////////////////////////////////////////////////////////
+// Flight recorder keeps the last messages of log in memory regardless of its
+// verbosity. Only message arguments are recorded and message is formatted only
+// when it is read or dumped. Recorded messages are dumped to outputs of log when
+// critical message is logged (that includes log_critical and log_fatal), by
+// log_recorder_dump and by crash handler (log_recorder_on_crash). Every output
+// receives only messages that it did not output because of its verbosity and
+// every message is dumped only once.
+// Note that all messages of log with flight recorder are passed to the library
+// and thus macros evaluate their arguments and log_would_log returns true.
+
+// Record up to given number of the last messages of log. Zero disables recording.
+void log_set_recorder(log_t, size_t entries) __attribute__((nonnull));
+
+// Write recorded messages that were not dumped yet to outputs of log
+void log_recorder_dump(log_t) __attribute__((nonnull));
+
+// Call callback for every recorded message (the oldest first) rendered with given
+// format (see log_add_output). Callback must not modify configuration of log.
+// Returns number of messages.
+size_t log_recorder_foreach(log_t, const char *format,
+		void (*callback)(const char *line, size_t len, void *data), void *data)
+	__attribute__((nonnull(1, 2, 3)));
+
+// Install handler of SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT that dumps
+// flight recorders of all logs and terminates program with the same signal. Lines
+// are written directly to outputs (bypassing queues of asynchronous and buffers
+// of buffered outputs). Returns false if handler can't be installed.
+bool log_recorder_on_crash();
+
+//// Message callsites ///////////////////////////////////////////////////////////
+// Every message in code has static descriptor placed in dedicated section of the
+// binary. This allows LogC to enumerate them and enable them individually
+// regardless of verbosity. Never modify these descriptors directly!
+struct log_callsite {
+	const char *file;
+	const char *func;
+	const char *format; // NULL if format is not a string literal
+	unsigned line;
+	int level; // LOG_CALLSITE_NO_LEVEL if level is not known at compile time
+	unsigned char flags; // LOG_CS_* flags
+	char *origin; // Cached rendered origin
+	struct log_ratelimit *ratelimit; // NULL if message is not rate limited
+	struct log_sampling *sampling; // NULL if message is not sampled
+};
+#define LOG_CALLSITE_NO_LEVEL (-128)
+// Message is outputted regardless of verbosity
+#define LOG_CS_ENABLED (1 << 0)
+
+// Enable or disable messages with matching origin regardless of verbosity.
+// File and function are patterns in fnmatch(3) format and NULL matches anything.
+// Line zero matches any line. Rule is also applied to the messages registered
+// later on (such as in libraries loaded at runtime). Rules are applied in order
+// of calls so later ones override previous ones.
+// Returns number of currently registered messages that were matched.
+size_t log_callsites_enable(const char *file, const char *func, unsigned line,
+		bool enable);
+
+// Call provided function for every registered message. Callback must not call
+// log_callsites_enable nor load or unload modules.
+void log_callsites_foreach(void (*callback)(const struct log_callsite*, void *data),
+		void *data) __attribute__((nonnull(1)));
+
+void _logc_register_callsites(struct log_callsite *start, struct log_callsite *stop);
+void _logc_unregister_callsites(struct log_callsite *start, struct log_callsite *stop);
+extern struct log_callsite __start_logc_callsites[] __attribute__((weak,visibility("hidden")));
+extern struct log_callsite __stop_logc_callsites[] __attribute__((weak,visibility("hidden")));
+__attribute__((constructor)) static void _logc_callsites_constructor(void) {
+	_logc_register_callsites(__start_logc_callsites, __stop_logc_callsites);
+}
+// Callsites of module are no longer valid once it is unloaded (dlclose)
+__attribute__((destructor)) static void _logc_callsites_destructor(void) {
+	_logc_unregister_callsites(__start_logc_callsites, __stop_logc_callsites);
+}
+
+
 //// Log function and helper macros //////////////////////////////////////////////
 void _logc(log_t, enum log_message_level,
 		const char *file, size_t line, const char *func,
-		const char *format, ...) __attribute__((nonnull,format(printf, 6, 7)));
+		const char *format, ...) __attribute__((nonnull,format(printf, 6, 7),cold,noinline));
+void _logc_callsite(struct log_callsite*, log_t, enum log_message_level,
+		const char *format, ...) __attribute__((nonnull,format(printf, 4, 5),cold,noinline));
+
+// Inline variant of log_would_log. It uses threshold cached in log (or the shared
+// one for logs that were never configured) if it is up to date and calls
+// log_would_log otherwise.
+static inline bool _logc_would_log(log_t log, int level) {
+	const struct _log_threshold *cache =
+		(const struct _log_threshold *)__atomic_load_n(&log->_log, __ATOMIC_RELAXED);
+	if (cache == NULL)
+		cache = &_logc_default_threshold;
+	level = level > LL_CRITICAL ? LL_CRITICAL : level < LL_TRACE ? LL_TRACE : level;
+	unsigned threshold = __atomic_load_n(&cache->value, __ATOMIC_RELAXED);
+	if (__builtin_expect(threshold >> _LOGC_THRESHOLD_GENERATION_SHIFT ==
+				__atomic_load_n(&_logc_generation, __ATOMIC_RELAXED) <<
+				_LOGC_THRESHOLD_GENERATION_SHIFT >> _LOGC_THRESHOLD_GENERATION_SHIFT, 1))
+		return level >= (int)(threshold & _LOGC_THRESHOLD_LEVEL) + LL_TRACE;
+	return log_would_log(log, level);
+}
+
+// Messages with level lower than this are removed at compile time (including
+// their format strings and origin). Arguments are still type checked.
+// You can define it before inclusion, for example: -DLOGC_MIN_LEVEL=LL_INFO
+#ifndef LOGC_MIN_LEVEL
+#define LOGC_MIN_LEVEL LL_TRACE
+#endif
 
-#define logc(logt, level, ...) _logc(logt, level, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define _LOGC_FIRST(first, ...) first
+// Callsite value that is used only if message is not removed at compile time
+#define _LOGC_CS_VALUE(level, value) \
+	(__builtin_constant_p(level) && (level) < LOGC_MIN_LEVEL ? NULL : (value))
+#define _LOGC_CS_FORMAT(format) (__builtin_constant_p(format) ? (format) : NULL)
+
+// Note that arguments are not evaluated if message would not be logged.
+// Callsite is explicitly aligned as otherwise compiler can align it more and that
+// breaks its walk in section.
+#define _LOGC(logt, msg_level, rl, sampl, ...) do { \
+		if ((msg_level) >= LOGC_MIN_LEVEL) { \
+			static struct log_callsite _logc_cs __attribute__((section("logc_callsites"), \
+					aligned(__alignof__(struct log_callsite)))) = { \
+				.file = _LOGC_CS_VALUE(msg_level, __FILE__), \
+				.func = _LOGC_CS_VALUE(msg_level, __func__), \
+				.format = _LOGC_CS_VALUE(msg_level, _LOGC_CS_FORMAT(_LOGC_FIRST(__VA_ARGS__, ))), \
+				.line = __LINE__, \
+				.level = __builtin_constant_p(msg_level) ? (msg_level) : LOG_CALLSITE_NO_LEVEL, \
+				.ratelimit = (rl), \
+				.sampling = (sampl), \
+			}; \
+			log_t _logc_log = (logt); \
+			int _logc_level = (msg_level); \
+			if (__builtin_expect(_logc_cs.flags || _logc_would_log(_logc_log, _logc_level), 0)) \
+				_logc_callsite(&_logc_cs, _logc_log, _logc_level, __VA_ARGS__); \
+		} \
+	} while (0)
+#define logc(logt, msg_level, ...) _LOGC(logt, msg_level, NULL, NULL, __VA_ARGS__)
+// Rate limited message (see struct log_ratelimit)
+#define logc_ratelimited(logt, msg_level, rl_burst, rl_interval, ...) do { \
+		static struct log_ratelimit _logc_rl = { \
+			.burst = (rl_burst), \
+			.interval = (rl_interval), \
+		}; \
+		_LOGC(logt, msg_level, &_logc_rl, NULL, __VA_ARGS__); \
+	} while (0)
+// Sampled message (see struct log_sampling)
+#define logc_sampled(logt, msg_level, smode, sn, sfirst, ...) do { \
+		static struct log_sampling _logc_sampling = { \
+			.mode = (smode), \
+			.n = (sn), \
+			.first = (sfirst), \
+		}; \
+		_LOGC(logt, msg_level, NULL, &_logc_sampling, __VA_ARGS__); \
+	} while (0)
 #define log_critical(logt, ...) do { logc(logt, LL_CRITICAL, __VA_ARGS__); log_flush(logt); abort(); } while (0)
-#define log_fatal(logt, exit_code, ...) do { logc(logt, LL_CRITICAL, __VA_ARGS__); exit(exit_code); } while (0)
+#define log_fatal(logt, exit_code, ...) do { logc(logt, LL_CRITICAL, __VA_ARGS__); log_flush(logt); exit(exit_code); } while (0)
 #define log_error(logt, ...) logc(logt, LL_ERROR, __VA_ARGS__)
 #define log_warning(logt, ...) logc(logt, LL_WARNING, __VA_ARGS__)
 #define log_notice(logt, ...) logc(logt, LL_NOTICE, __VA_ARGS__)
 #define log_info(logt, ...) logc(logt, LL_INFO, __VA_ARGS__)
 #define log_debug(logt, ...) logc(logt, LL_DEBUG, __VA_ARGS__)
 #define log_trace(logt, ...) logc(logt, LL_TRACE, __VA_ARGS__)
+// Rate limited variants with LOG_RATELIMIT_BURST messages per LOG_RATELIMIT_INTERVAL
+#define _LOGC_RL(logt, msg_level, ...) \
+	logc_ratelimited(logt, msg_level, LOG_RATELIMIT_BURST, LOG_RATELIMIT_INTERVAL, __VA_ARGS__)
+#define log_error_ratelimited(logt, ...) _LOGC_RL(logt, LL_ERROR, __VA_ARGS__)
+#define log_warning_ratelimited(logt, ...) _LOGC_RL(logt, LL_WARNING, __VA_ARGS__)
+#define log_notice_ratelimited(logt, ...) _LOGC_RL(logt, LL_NOTICE, __VA_ARGS__)
+#define log_info_ratelimited(logt, ...) _LOGC_RL(logt, LL_INFO, __VA_ARGS__)
+#define log_debug_ratelimited(logt, ...) _LOGC_RL(logt, LL_DEBUG, __VA_ARGS__)
+// Sampled variants that output randomly one of N messages
+#define log_debug_sampled(logt, n, ...) \
+	logc_sampled(logt, LL_DEBUG, LOG_SAMPLE_RANDOM, n, 0, __VA_ARGS__)
+#define log_trace_sampled(logt, n, ...) \
+	logc_sampled(logt, LL_TRACE, LOG_SAMPLE_RANDOM, n, 0, __VA_ARGS__)
 
 #endif
 
@@ -217,6 +625,13 @@ void _logc(log_t, enum log_message_level,
 #define info(...) log_info(DEFLOG, __VA_ARGS__)
 #define debug(...) log_debug(DEFLOG, __VA_ARGS__)
 #define trace(...) log_trace(DEFLOG, __VA_ARGS__)
+#define error_ratelimited(...) log_error_ratelimited(DEFLOG, __VA_ARGS__)
+#define warning_ratelimited(...) log_warning_ratelimited(DEFLOG, __VA_ARGS__)
+#define notice_ratelimited(...) log_notice_ratelimited(DEFLOG, __VA_ARGS__)
+#define info_ratelimited(...) log_info_ratelimited(DEFLOG, __VA_ARGS__)
+#define debug_ratelimited(...) log_debug_ratelimited(DEFLOG, __VA_ARGS__)
+#define debug_sampled(...) log_debug_sampled(DEFLOG, __VA_ARGS__)
+#define trace_sampled(...) log_trace_sampled(DEFLOG, __VA_ARGS__)
 
 #endif
 #endif
@@ -0,0 +1,364 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "async.h"
+#include "output.h"
+#include "deferred.h"
+#include "uring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+// The queue is bounded multi-producer queue as described by Dmitry Vyukov. Every
+// slot has sequence number that tells if it is free for position being enqueued
+// or filled for position being dequeued. Producers can also dequeue to drop the
+// oldest line. Lines are stored in the slot unless they are too long.
+struct slot {
+	size_t seq;
+	char *data; // NULL if line is stored in line
+	size_t len;
+	bool deferred; // data is message captured by deferred_capture
+	char line[ASYNC_LINE_SIZE];
+};
+
+// Line taken from the queue
+struct queued_line {
+	char *data; // points to buf unless line was allocated
+	size_t len;
+	bool deferred;
+	char buf[ASYNC_LINE_SIZE];
+};
+
+struct async {
+	const struct output *out;
+	enum async_policy policy;
+	bool uring; // write using io_uring if available
+	unsigned fork_generation;
+	pthread_t thread;
+
+	struct slot slots[ASYNC_QUEUE_SIZE];
+	size_t enqueue_pos __attribute__((aligned(64)));
+	size_t dequeue_pos __attribute__((aligned(64)));
+	size_t completed; // lines written or dropped from queue
+	size_t dropped;
+
+	// Slow path used only when writer waits for lines or producers wait for writer
+	pthread_mutex_t mutex;
+	pthread_cond_t wake; // writer waits for lines
+	pthread_cond_t progress; // producers wait for lines to be written
+	bool sleeping;
+	unsigned waiters;
+	bool stop;
+
+	struct async *next, **prev;
+};
+
+// All asynchronous outputs so queued lines can be written on exit
+static struct async *asyncs = NULL;
+static pthread_mutex_t asyncs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Writer thread does not exist in forked process
+static unsigned fork_generation = 0;
+
+static void flush_all();
+
+static void atfork_prepare() {
+	pthread_mutex_lock(&asyncs_mutex);
+}
+
+static void atfork_parent() {
+	pthread_mutex_unlock(&asyncs_mutex);
+}
+
+static void atfork_child() {
+	fork_generation++;
+	pthread_mutex_unlock(&asyncs_mutex);
+}
+
+__attribute__((constructor))
+static void constructor() {
+	pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+	atexit(flush_all);
+}
+
+// Wait for lines queued by all asynchronous outputs to be written. Writer collects
+// lines to the buffer of output and thus that one is flushed as well as exit
+// handler of buffers could already run.
+static void flush_all() {
+	pthread_mutex_lock(&asyncs_mutex);
+	for (struct async *async = asyncs; async; async = async->next) {
+		async_flush(async);
+		if (async->fork_generation == fork_generation && async->out->buffer)
+			buffer_flush(async->out->buffer);
+	}
+	pthread_mutex_unlock(&asyncs_mutex);
+}
+
+
+// Line is copied out of the slot so slot can be reused right away
+static bool dequeue(struct async *async, struct queued_line *line) {
+	size_t pos = __atomic_load_n(&async->dequeue_pos, __ATOMIC_RELAXED);
+	while (true) {
+		struct slot *slot = &async->slots[pos % ASYNC_QUEUE_SIZE];
+		size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		ssize_t diff = (ssize_t)seq - (ssize_t)(pos + 1);
+		if (diff < 0)
+			return false; // Empty
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&async->dequeue_pos, &pos, pos + 1,
+						true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				line->len = slot->len;
+				line->deferred = slot->deferred;
+				if (slot->data)
+					line->data = slot->data;
+				else {
+					line->data = line->buf;
+					memcpy(line->buf, slot->line, slot->len);
+				}
+				__atomic_store_n(&slot->seq, pos + ASYNC_QUEUE_SIZE, __ATOMIC_RELEASE);
+				return true;
+			}
+		} else
+			pos = __atomic_load_n(&async->dequeue_pos, __ATOMIC_RELAXED);
+	}
+}
+
+static void release_line(struct queued_line *line) {
+	if (line->data != line->buf)
+		free(line->data);
+}
+
+static bool queue_empty(struct async *async) {
+	size_t pos = __atomic_load_n(&async->dequeue_pos, __ATOMIC_RELAXED);
+	struct slot *slot = &async->slots[pos % ASYNC_QUEUE_SIZE];
+	return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+static void complete(struct async *async, size_t lines) {
+	if (lines == 0)
+		return;
+	__atomic_add_fetch(&async->completed, lines, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&async->waiters, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&async->mutex);
+		pthread_cond_broadcast(&async->progress);
+		pthread_mutex_unlock(&async->mutex);
+	}
+}
+
+static void *writer(void *data) {
+	struct async *async = data;
+	struct record record;
+	record_init(&record);
+	struct uring *uring = async->uring ? uring_new(async->out->fd) : NULL;
+	struct queued_line line;
+	while (true) {
+		if (dequeue(async, &line)) {
+			const char *data = line.data;
+			size_t len = line.len;
+			if (line.deferred) {
+				record.len = 0;
+				deferred_render(&record, async->out, line.data, line.len);
+				data = record.data;
+				len = record.len; // nothing is written for invalid message
+			}
+			if (uring)
+				complete(async, uring_write(uring, data, len));
+			else if (async->out->buffer) {
+				buffer_write(async->out->buffer, data, len, false);
+				complete(async, 1);
+			} else {
+				lock_output(async->out);
+				output_write(async->out, data, len);
+				unlock_output(async->out);
+				complete(async, 1);
+			}
+			release_line(&line);
+			continue;
+		}
+		// Queue is empty so the collected lines are written
+		if (uring)
+			complete(async, uring_wait(uring));
+		else if (async->out->buffer)
+			buffer_flush(async->out->buffer);
+
+		pthread_mutex_lock(&async->mutex);
+		__atomic_store_n(&async->sleeping, true, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (queue_empty(async)) {
+			if (async->stop) {
+				pthread_mutex_unlock(&async->mutex);
+				break;
+			}
+			pthread_cond_wait(&async->wake, &async->mutex);
+		}
+		__atomic_store_n(&async->sleeping, false, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&async->mutex);
+	}
+	uring_free(uring);
+	record_free(&record);
+	return NULL;
+}
+
+struct async *async_new(const struct output *out, enum async_policy policy,
+		bool uring) {
+	struct async *async = malloc(sizeof *async);
+	*async = (struct async){
+		.out = out,
+		.policy = policy,
+		.uring = uring,
+		.fork_generation = fork_generation,
+	};
+	for (size_t i = 0; i < ASYNC_QUEUE_SIZE; i++)
+		async->slots[i].seq = i;
+	pthread_mutex_init(&async->mutex, NULL);
+	pthread_cond_init(&async->wake, NULL);
+	pthread_cond_init(&async->progress, NULL);
+
+	// Signals should be handled by threads of application, not by our writer
+	sigset_t set, origset;
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &origset);
+	if (pthread_create(&async->thread, NULL, writer, async)) {
+		pthread_sigmask(SIG_SETMASK, &origset, NULL);
+		free(async);
+		return NULL;
+	}
+	pthread_sigmask(SIG_SETMASK, &origset, NULL);
+
+	pthread_mutex_lock(&asyncs_mutex);
+	async->next = asyncs;
+	async->prev = &asyncs;
+	if (asyncs)
+		asyncs->prev = &async->next;
+	asyncs = async;
+	pthread_mutex_unlock(&asyncs_mutex);
+	return async;
+}
+
+void async_free(struct async *async) {
+	if (async == NULL)
+		return;
+	pthread_mutex_lock(&asyncs_mutex);
+	if (async->next)
+		async->next->prev = async->prev;
+	*async->prev = async->next;
+	pthread_mutex_unlock(&asyncs_mutex);
+	if (async->fork_generation == fork_generation) {
+		pthread_mutex_lock(&async->mutex);
+		async->stop = true;
+		pthread_cond_signal(&async->wake);
+		pthread_mutex_unlock(&async->mutex);
+		pthread_join(async->thread, NULL);
+		pthread_mutex_destroy(&async->mutex);
+		pthread_cond_destroy(&async->wake);
+		pthread_cond_destroy(&async->progress);
+	} else {
+		// There is no writer in forked process so just drop queued lines. Mutex and
+		// conditions are not destroyed as they can be in use by the writer that is
+		// copied from parent (destroy would wait for it forever).
+		struct queued_line line;
+		while (dequeue(async, &line))
+			release_line(&line);
+	}
+	free(async);
+}
+
+// Wait for given number of lines to be written or dropped
+static void wait_progress(struct async *async, size_t target) {
+	pthread_mutex_lock(&async->mutex);
+	__atomic_add_fetch(&async->waiters, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&async->completed, __ATOMIC_SEQ_CST) < target)
+		pthread_cond_wait(&async->progress, &async->mutex);
+	__atomic_sub_fetch(&async->waiters, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&async->mutex);
+}
+
+static bool enqueue(struct async *async, const char *data, size_t len, bool deferred) {
+	if (async->fork_generation != fork_generation)
+		return false;
+	// Only lines that do not fit to the slot are allocated. Line is truncated if
+	// that fails. Captured message can't be truncated and thus it is dropped.
+	char *copy = NULL;
+	bool truncated = false;
+	if (len > ASYNC_LINE_SIZE) {
+		copy = malloc(len);
+		if (copy)
+			memcpy(copy, data, len);
+		else if (deferred) {
+			__atomic_add_fetch(&async->dropped, 1, __ATOMIC_RELAXED);
+			return true;
+		} else {
+			len = ASYNC_LINE_SIZE;
+			truncated = true;
+		}
+	}
+
+	size_t pos = __atomic_load_n(&async->enqueue_pos, __ATOMIC_RELAXED);
+	while (true) {
+		struct slot *slot = &async->slots[pos % ASYNC_QUEUE_SIZE];
+		size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		ssize_t diff = (ssize_t)seq - (ssize_t)pos;
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&async->enqueue_pos, &pos, pos + 1,
+						true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				slot->data = copy;
+				slot->len = len;
+				if (copy == NULL) {
+					memcpy(slot->line, data, len);
+					if (truncated)
+						slot->line[len - 1] = '\n';
+				}
+				slot->deferred = deferred;
+				__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+				break;
+			}
+		} else if (diff < 0) { // Queue is full
+			struct queued_line old;
+			switch (async->policy) {
+				case AP_BLOCK:
+					wait_progress(async, pos + 1 - ASYNC_QUEUE_SIZE);
+					break;
+				case AP_DROP_NEWEST:
+					__atomic_add_fetch(&async->dropped, 1, __ATOMIC_RELAXED);
+					free(copy);
+					return true;
+				case AP_DROP_OLDEST:
+					if (dequeue(async, &old)) {
+						release_line(&old);
+						__atomic_add_fetch(&async->dropped, 1, __ATOMIC_RELAXED);
+						complete(async, 1);
+					}
+					break;
+			}
+			pos = __atomic_load_n(&async->enqueue_pos, __ATOMIC_RELAXED);
+		} else
+			pos = __atomic_load_n(&async->enqueue_pos, __ATOMIC_RELAXED);
+	}
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&async->sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&async->mutex);
+		pthread_cond_signal(&async->wake);
+		pthread_mutex_unlock(&async->mutex);
+	}
+	return true;
+}
+
+bool async_write(struct async *async, const char *data, size_t len) {
+	return enqueue(async, data, len, false);
+}
+
+bool async_write_deferred(struct async *async, const char *data, size_t len) {
+	return enqueue(async, data, len, true);
+}
+
+void async_flush(struct async *async) {
+	if (async->fork_generation != fork_generation)
+		return;
+	wait_progress(async, __atomic_load_n(&async->enqueue_pos, __ATOMIC_SEQ_CST));
+}
+
+size_t async_dropped(const struct async *async) {
+	return __atomic_load_n(&async->dropped, __ATOMIC_RELAXED);
+}
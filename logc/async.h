@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_ASYNC_H_
+#define _LOGC_ASYNC_H_
+#include <stdbool.h>
+#include <stddef.h>
+
+struct output;
+
+// Number of lines that can be queued for single asynchronous output
+#define ASYNC_QUEUE_SIZE 1024
+// Lines up to this size are stored directly in the queue. Longer ones are
+// allocated.
+#define ASYNC_LINE_SIZE 256
+
+enum async_policy {
+	AP_BLOCK, // wait for the space in the queue
+	AP_DROP_NEWEST, // drop line being queued
+	AP_DROP_OLDEST, // drop the oldest line in the queue
+};
+
+struct async;
+
+// Start writer thread for given output. The output has to be valid for the lifetime
+// of asynchronous writer. It can be modified until the first line is queued so
+// that outputs can be complemented after new_output. Lines are written using
+// io_uring if uring is true and io_uring is available.
+struct async *async_new(const struct output *out, enum async_policy policy,
+		bool uring) __attribute__((nonnull));
+// Write all queued lines and stop writer thread.
+void async_free(struct async *async);
+
+// Queue line to be written. Returns false if line can't be queued because writer
+// thread is not running (that is in forked process) and line has to be written
+// directly. Line that fits to ASYNC_LINE_SIZE is queued without allocation.
+bool async_write(struct async *async, const char *data, size_t len)
+	__attribute__((nonnull));
+
+// Queue message captured by deferred_capture. Line is rendered by writer thread.
+// Return value has the same meaning as for async_write.
+bool async_write_deferred(struct async *async, const char *data, size_t len)
+	__attribute__((nonnull));
+
+// Wait for all lines queued so far to be written.
+void async_flush(struct async *async) __attribute__((nonnull));
+
+// Number of lines dropped so far
+size_t async_dropped(const struct async *async) __attribute__((nonnull));
+
+#endif
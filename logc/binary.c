@@ -0,0 +1,446 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "binary.h"
+#include "output.h"
+#include "spec.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <time.h>
+
+// Dictionary maps pointers to identifiers. Content is compared as well as the
+// same pointer can be reused with different content (such as error messages or
+// formats that are not literals).
+struct entry {
+	const char *str; // format or string
+	const char *file, *func; // only for formats
+	size_t line;
+	char *copy;
+	uint64_t id;
+};
+
+struct dict {
+	struct entry *entries;
+	size_t size, cnt;
+	uint64_t next_id;
+};
+
+struct binary {
+	pthread_mutex_t mutex;
+	bool started;
+	time_t second; // second of the last time frame
+	struct dict formats, strings;
+};
+
+// Messages that could not be captured are stored as text with this format
+static const char text_format[] = "%s";
+
+
+struct binary *binary_new(void) {
+	struct binary *binary = calloc(1, sizeof *binary);
+	pthread_mutex_init(&binary->mutex, NULL);
+	return binary;
+}
+
+static void dict_free(struct dict *dict) {
+	for (size_t i = 0; i < dict->size; i++)
+		free(dict->entries[i].copy);
+	free(dict->entries);
+}
+
+void binary_free(struct binary *binary) {
+	if (binary == NULL)
+		return;
+	dict_free(&binary->formats);
+	dict_free(&binary->strings);
+	pthread_mutex_destroy(&binary->mutex);
+	free(binary);
+}
+
+static size_t hash(const struct entry *e) {
+	size_t h = (uintptr_t)e->str;
+	h = h * 31 + (uintptr_t)e->file;
+	h = h * 31 + (uintptr_t)e->func;
+	h = h * 31 + e->line;
+	return h ^ (h >> 17);
+}
+
+static struct entry *dict_slot(struct entry *entries, size_t size,
+		const struct entry *key) {
+	size_t i = hash(key) & (size - 1);
+	while (entries[i].str && !(entries[i].str == key->str &&
+				entries[i].file == key->file && entries[i].func == key->func &&
+				entries[i].line == key->line))
+		i = (i + 1) & (size - 1);
+	return &entries[i];
+}
+
+// Locate identifier for given key. Returns true if new identifier was assigned
+// and thus dictionary frame has to be written.
+static bool dict_intern(struct dict *dict, const struct entry *key, uint64_t *id) {
+	if (dict->size) {
+		struct entry *e = dict_slot(dict->entries, dict->size, key);
+		if (e->str) {
+			if (!strcmp(e->copy, key->str)) {
+				*id = e->id;
+				return false;
+			}
+			// Content changed so new identifier has to be assigned
+			free(e->copy);
+			e->copy = strdup(key->str);
+			*id = e->id = ++dict->next_id;
+			return true;
+		}
+	}
+	if (2 * (dict->cnt + 1) > dict->size) {
+		size_t size = dict->size ? 2 * dict->size : 64;
+		struct entry *entries = calloc(size, sizeof *entries);
+		for (size_t i = 0; i < dict->size; i++)
+			if (dict->entries[i].str)
+				*dict_slot(entries, size, &dict->entries[i]) = dict->entries[i];
+		free(dict->entries);
+		dict->entries = entries;
+		dict->size = size;
+	}
+	struct entry *e = dict_slot(dict->entries, dict->size, key);
+	*e = *key;
+	e->copy = strdup(key->str);
+	*id = e->id = ++dict->next_id;
+	dict->cnt++;
+	return true;
+}
+
+// Append frame with payload from body to the record
+static void frame(struct record *r, enum binary_frame type, const struct record *body) {
+	binary_put_uint(r, body->len + 1);
+	char t = type;
+	record_append(r, &t, 1);
+	record_append(r, body->data, body->len);
+}
+
+// Intern string and write dictionary frame if needed. Zero is returned for NULL.
+static uint64_t intern_string(struct binary *binary, struct record *r,
+		struct record *body, const char *str) {
+	if (str == NULL)
+		return 0;
+	uint64_t id;
+	if (dict_intern(&binary->strings, &(struct entry){.str = str}, &id)) {
+		body->len = 0;
+		binary_put_uint(body, id);
+		binary_put_str(body, str, strlen(str));
+		frame(r, BF_STRING, body);
+	}
+	return id;
+}
+
+bool binary_emit(const struct output *out, const struct binary_message *msg) {
+	struct binary *binary = out->binary;
+	struct record args;
+	record_init(&args);
+	const char *format = msg->format;
+	if (format) {
+		va_list cargs;
+		va_copy(cargs, *msg->args);
+		bool captured = binary_capture(&args, format, cargs);
+		va_end(cargs);
+		if (!captured) {
+			record_free(&args);
+			return false;
+		}
+	} else {
+		format = text_format;
+		binary_put_str(&args, msg->text, msg->len);
+	}
+	struct timespec ts = {0};
+	if (log_time_read(msg->time, LT_REAL))
+		ts = msg->time->real;
+	const char *err = msg->stderrno ? strerror(msg->stderrno) : NULL;
+
+	struct record r, body;
+	record_init(&r);
+	record_init(&body);
+	// Dictionary frames have to precede the first message that uses them and thus
+	// output is written while lock is held.
+	pthread_mutex_lock(&binary->mutex);
+	if (!binary->started) {
+		record_puts(&body, BINARY_MAGIC);
+		binary_put_uint(&body, BINARY_VERSION);
+		frame(&r, BF_HEADER, &body);
+		binary->started = true;
+	}
+	uint64_t format_id;
+	struct entry key = {
+		.str = format,
+		.file = msg->file,
+		.func = msg->func,
+		.line = msg->line,
+	};
+	if (dict_intern(&binary->formats, &key, &format_id)) {
+		body.len = 0;
+		binary_put_uint(&body, format_id);
+		binary_put_str(&body, format, strlen(format));
+		binary_put_str(&body, msg->file, msg->file ? strlen(msg->file) : 0);
+		binary_put_uint(&body, msg->line);
+		binary_put_str(&body, msg->func, msg->func ? strlen(msg->func) : 0);
+		frame(&r, BF_FORMAT, &body);
+	}
+	if (ts.tv_sec != binary->second) {
+		body.len = 0;
+		binary_put_uint(&body, ts.tv_sec);
+		frame(&r, BF_TIME, &body);
+		binary->second = ts.tv_sec;
+	}
+	uint64_t name_id = intern_string(binary, &r, &body, msg->name);
+	uint64_t err_id = intern_string(binary, &r, &body, err);
+
+	body.len = 0;
+	binary_put_uint(&body, format_id);
+	binary_put_uint(&body, name_id);
+	binary_put_uint(&body, err_id);
+	binary_put_int(&body, msg->level);
+	binary_put_uint(&body, ts.tv_nsec);
+	binary_put_uint(&body, (msg->use_origin ? BMF_USE_ORIGIN : 0) |
+			(msg->sample_rate > 1 ? BMF_SAMPLED : 0));
+	if (msg->sample_rate > 1)
+		binary_put_uint(&body, msg->sample_rate);
+	record_append(&body, args.data, args.len);
+	frame(&r, BF_MESSAGE, &body);
+
+	output_emit(out, r.data, r.len, msg->level >= LL_ERROR);
+	pthread_mutex_unlock(&binary->mutex);
+
+	record_free(&r);
+	record_free(&body);
+	record_free(&args);
+	return true;
+}
+
+
+void binary_put_uint(struct record *r, uint64_t value) {
+	char buf[10];
+	size_t len = 0;
+	do {
+		buf[len] = value & 0x7f;
+		value >>= 7;
+		if (value)
+			buf[len] |= 0x80;
+		len++;
+	} while (value);
+	record_append(r, buf, len);
+}
+
+void binary_put_int(struct record *r, int64_t value) {
+	binary_put_uint(r, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void binary_put_str(struct record *r, const char *str, size_t len) {
+	if (str == NULL) {
+		binary_put_uint(r, 0);
+		return;
+	}
+	binary_put_uint(r, len + 1);
+	record_append(r, str, len);
+}
+
+bool binary_get_uint(const char **data, const char *end, uint64_t *value) {
+	*value = 0;
+	for (unsigned shift = 0; *data < end && shift < 64; shift += 7) {
+		unsigned char c = *(*data)++;
+		*value |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool binary_get_int(const char **data, const char *end, int64_t *value) {
+	uint64_t v;
+	if (!binary_get_uint(data, end, &v))
+		return false;
+	*value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+	return true;
+}
+
+bool binary_get_str(const char **data, const char *end, const char **str,
+		size_t *len) {
+	uint64_t v;
+	if (!binary_get_uint(data, end, &v) || (v && v - 1 > (uint64_t)(end - *data)))
+		return false;
+	*str = v ? *data : NULL;
+	*len = v ? v - 1 : 0;
+	*data += *len;
+	return true;
+}
+
+// Doubles are stored as 64-bit IEEE 754 in little endian
+static void put_double(struct record *r, double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof bits);
+	char buf[8];
+	for (size_t i = 0; i < 8; i++)
+		buf[i] = bits >> (8 * i);
+	record_append(r, buf, 8);
+}
+
+static bool get_double(const char **data, const char *end, double *value) {
+	if (end - *data < 8)
+		return false;
+	uint64_t bits = 0;
+	for (size_t i = 0; i < 8; i++)
+		bits |= (uint64_t)(unsigned char)(*data)[i] << (8 * i);
+	*data += 8;
+	memcpy(value, &bits, sizeof bits);
+	return true;
+}
+
+bool binary_capture(struct record *r, const char *format, va_list args) {
+	for (const char *c = strchr(format, '%'); c; c = strchr(c, '%')) {
+		struct spec spec;
+		if (!parse_spec(c, &spec))
+			return false;
+		c += spec.len;
+		int precision = spec.precision;
+		if (spec.width_arg)
+			binary_put_int(r, va_arg(args, int));
+		if (spec.precision_arg) {
+			precision = va_arg(args, int);
+			binary_put_int(r, precision);
+		}
+
+		// Integers are stored extended to 64 bits so they are independent of the
+		// size of types on the platform.
+#define CAPTURE(TYPE, UTYPE) do { \
+			TYPE value = va_arg(args, TYPE); \
+			if (spec.is_unsigned) \
+				binary_put_uint(r, (UTYPE)value); \
+			else \
+				binary_put_int(r, value); \
+		} while (false)
+		switch (spec.type) {
+			case AT_NONE:
+				break;
+			case AT_INT:
+				CAPTURE(int, unsigned);
+				break;
+			case AT_LONG:
+				CAPTURE(long, unsigned long);
+				break;
+			case AT_LLONG:
+				CAPTURE(long long, unsigned long long);
+				break;
+			case AT_INTMAX:
+				CAPTURE(intmax_t, uintmax_t);
+				break;
+			case AT_SIZE:
+				CAPTURE(ssize_t, size_t);
+				break;
+			case AT_PTRDIFF:
+				CAPTURE(ptrdiff_t, size_t);
+				break;
+			case AT_DOUBLE:
+				put_double(r, va_arg(args, double));
+				break;
+			case AT_LDOUBLE:
+				put_double(r, va_arg(args, long double));
+				break;
+			case AT_PTR:
+				binary_put_uint(r, (uintptr_t)va_arg(args, void *));
+				break;
+			case AT_STR: {
+				// Only what would be printed is stored as string does not have to
+				// be terminated if precision is specified.
+				const char *str = va_arg(args, const char *);
+				binary_put_str(r, str,
+						str ? precision >= 0 ? strnlen(str, precision) : strlen(str) : 0);
+				break;
+			}
+		}
+#undef CAPTURE
+	}
+	return true;
+}
+
+bool binary_render(struct record *r, const char *format, const char **data,
+		const char *end) {
+	const char *c = format;
+	while (true) {
+		const char *next = strchr(c, '%');
+		if (next == NULL) {
+			record_puts(r, c);
+			return true;
+		}
+		record_append(r, c, next - c);
+		struct spec spec;
+		if (!parse_spec(next, &spec))
+			return false;
+		c = next + spec.len;
+
+		int64_t width = 0, precision = -1;
+		if (spec.width_arg && !binary_get_int(data, end, &width))
+			return false;
+		if (spec.precision_arg && !binary_get_int(data, end, &precision))
+			return false;
+		char buf[SPEC_BUF_SIZE];
+		// Integers wider than int are printed as long long on this platform
+		bool wide = spec.type >= AT_LONG && spec.type <= AT_PTRDIFF;
+		spec_build(buf, next, &spec, width, precision, wide ? "ll" : NULL);
+
+		uint64_t uvalue;
+		int64_t ivalue;
+		double dvalue;
+		switch (spec.type) {
+			case AT_NONE:
+				record_append(r, "%", 1);
+				break;
+			case AT_INT:
+			case AT_LONG:
+			case AT_LLONG:
+			case AT_INTMAX:
+			case AT_SIZE:
+			case AT_PTRDIFF:
+				if (spec.is_unsigned) {
+					if (!binary_get_uint(data, end, &uvalue))
+						return false;
+				} else {
+					if (!binary_get_int(data, end, &ivalue))
+						return false;
+					uvalue = ivalue;
+				}
+				if (wide)
+					record_printf(r, buf, (long long)uvalue);
+				else
+					record_printf(r, buf, (int)uvalue);
+				break;
+			case AT_DOUBLE:
+				if (!get_double(data, end, &dvalue))
+					return false;
+				record_printf(r, buf, dvalue);
+				break;
+			case AT_LDOUBLE:
+				if (!get_double(data, end, &dvalue))
+					return false;
+				record_printf(r, buf, (long double)dvalue);
+				break;
+			case AT_PTR:
+				if (!binary_get_uint(data, end, &uvalue))
+					return false;
+				record_printf(r, buf, (void *)(uintptr_t)uvalue);
+				break;
+			case AT_STR: {
+				const char *str;
+				size_t len;
+				if (!binary_get_str(data, end, &str, &len))
+					return false;
+				if (str) {
+					char *copy = strndup(str, len);
+					record_printf(r, buf, copy);
+					free(copy);
+				} else
+					record_printf(r, buf, "(null)");
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_BINARY_H_
+#define _LOGC_BINARY_H_
+#include <logc.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include "record.h"
+#include "timestamp.h"
+
+// Binary output is sequence of frames. Every frame starts with its length
+// (variable length integer) followed by frame type (single byte) and payload.
+// Unsigned integers are encoded in LEB128 and signed ones are zigzag encoded
+// first. Strings are stored with length plus one (zero is used for NULL) followed
+// by bytes of string.
+#define BINARY_MAGIC "LOGC"
+#define BINARY_VERSION 1
+
+enum binary_frame {
+	// Start of the stream. It resets dictionary.
+	// Payload: magic (without null byte), version
+	BF_HEADER = 0,
+	// Dictionary entry for message format and its source location.
+	// Payload: id, format, file, line, function
+	BF_FORMAT = 1,
+	// Dictionary entry for string (log name or error message)
+	// Payload: id, string
+	BF_STRING = 2,
+	// Log message. Its time is the second of the last time frame plus nanoseconds.
+	// Payload: format id, name id, error id, level (signed), nanoseconds,
+	// flags (BMF_*), sampling rate (only with BMF_SAMPLED), arguments
+	BF_MESSAGE = 3,
+	// Time (seconds since epoch) of following messages. It is written before the
+	// first message in every second.
+	// Payload: seconds
+	BF_TIME = 4,
+};
+
+// Message flags
+#define BMF_USE_ORIGIN (1 << 0)
+// Sampling rate follows flags
+#define BMF_SAMPLED (1 << 1)
+
+// Message to be written to binary output
+struct binary_message {
+	enum log_message_level level;
+	const char *name;
+	const char *file;
+	size_t line;
+	const char *func;
+	bool use_origin;
+	int stderrno;
+	const char *format; // message format or NULL if text is provided
+	va_list *args;
+	const char *text;
+	size_t len;
+	struct log_time *time; // shared with other outputs
+	unsigned sample_rate;
+};
+
+struct binary;
+struct output;
+
+// Allocate state (dictionary) of binary output
+struct binary *binary_new(void);
+void binary_free(struct binary *binary);
+
+// Write message to binary output. Returns false if message arguments can't be
+// captured and message has to be provided as text instead.
+bool binary_emit(const struct output *out, const struct binary_message *msg)
+	__attribute__((nonnull));
+
+
+void binary_put_uint(struct record *r, uint64_t value) __attribute__((nonnull));
+void binary_put_int(struct record *r, int64_t value) __attribute__((nonnull));
+void binary_put_str(struct record *r, const char *str, size_t len)
+	__attribute__((nonnull(1)));
+
+// Decoding functions move data pointer behind decoded value. They return false if
+// there is not enough data.
+bool binary_get_uint(const char **data, const char *end, uint64_t *value)
+	__attribute__((nonnull));
+bool binary_get_int(const char **data, const char *end, int64_t *value)
+	__attribute__((nonnull));
+// String is not terminated and NULL is provided if NULL was stored
+bool binary_get_str(const char **data, const char *end, const char **str,
+		size_t *len) __attribute__((nonnull));
+
+// Capture arguments in portable binary form. Returns false if format contains
+// conversion that can't be captured.
+bool binary_capture(struct record *r, const char *format, va_list args)
+	__attribute__((nonnull));
+// Render message from format and arguments captured by binary_capture. Returns
+// false if arguments are malformed.
+bool binary_render(struct record *r, const char *format, const char **data,
+		const char *end) __attribute__((nonnull));
+
+#endif
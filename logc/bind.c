@@ -1,20 +1,25 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // Copyright 2021, CZ.NIC z.s.p.o. (http://www.nic.cz/)
 #include "log.h"
+#include "config.h"
 
 void log_bind(log_t dominant, log_t submissive) {
-	log_allocate(submissive);
-	submissive->_log->dominator = dominant;
+	struct log_config *config = config_edit(submissive);
+	config->dominator = dominant;
+	config_commit(submissive, config);
 }
 
 log_t log_bound(log_t log) {
-	if (log->_log == NULL)
-		return NULL;
-	return log->_log->dominator;
+	config_read_lock();
+	log_t res = log_config(log)->dominator;
+	config_read_unlock();
+	return res;
 }
 
 void log_unbind(log_t log) {
 	if (log->_log == NULL)
 		return;
-	log->_log->dominator = NULL;
+	struct log_config *config = config_edit(log);
+	config->dominator = NULL;
+	config_commit(log, config);
 }
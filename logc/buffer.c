@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "buffer.h"
+#include "output.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
+
+struct buffer {
+	const struct output *out;
+	bool timer;
+	pthread_mutex_t mutex;
+	char *data;
+	size_t len;
+	size_t lines;
+	struct buffer *next, **prev;
+};
+
+// All buffers so they can be flushed by flusher thread and on exit
+static struct buffer *buffers = NULL;
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Flusher thread is started with the first buffer with timer (or again in forked
+// process)
+static bool flusher_running = false;
+
+static void flush_all();
+
+// Buffers are locked over fork so child does not inherit buffer locked by some
+// other thread
+static void atfork_prepare() {
+	pthread_mutex_lock(&buffers_mutex);
+	for (struct buffer *b = buffers; b; b = b->next)
+		pthread_mutex_lock(&b->mutex);
+}
+
+static void atfork_parent() {
+	for (struct buffer *b = buffers; b; b = b->next)
+		pthread_mutex_unlock(&b->mutex);
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+static void atfork_child() {
+	__atomic_store_n(&flusher_running, false, __ATOMIC_RELAXED); // no thread in child
+	// Buffered lines are written by parent and thus child drops its copy
+	for (struct buffer *b = buffers; b; b = b->next) {
+		b->len = 0;
+		b->lines = 0;
+		pthread_mutex_unlock(&b->mutex);
+	}
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+__attribute__((constructor))
+static void constructor() {
+	pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+	atexit(flush_all);
+}
+
+
+// Write buffered lines. Buffer has to be locked.
+static void flush_locked(struct buffer *b) {
+	if (b->len == 0)
+		return;
+	lock_output(b->out);
+	output_write(b->out, b->data, b->len);
+	unlock_output(b->out);
+	b->len = 0;
+	b->lines = 0;
+}
+
+static void flush_all_filter(bool timer_only) {
+	pthread_mutex_lock(&buffers_mutex);
+	for (struct buffer *b = buffers; b; b = b->next)
+		if (!timer_only || b->timer) {
+			pthread_mutex_lock(&b->mutex);
+			flush_locked(b);
+			pthread_mutex_unlock(&b->mutex);
+		}
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+static void flush_all() {
+	flush_all_filter(false);
+}
+
+static void *flusher(void *data) {
+	int tfd = (intptr_t)data;
+	while (true) {
+		uint64_t expirations;
+		if (read(tfd, &expirations, sizeof expirations) == -1 && errno != EINTR)
+			break;
+		flush_all_filter(true);
+	}
+	close(tfd);
+	return NULL;
+}
+
+// Start flusher if it is not running yet. Buffers have to be locked.
+static void start_flusher() {
+	if (__atomic_load_n(&flusher_running, __ATOMIC_RELAXED))
+		return;
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (tfd == -1)
+		return;
+	struct timespec interval = {
+		.tv_sec = LOG_BUFFER_INTERVAL / 1000,
+		.tv_nsec = (LOG_BUFFER_INTERVAL % 1000) * 1000000,
+	};
+	timerfd_settime(tfd, 0, &(struct itimerspec){interval, interval}, NULL);
+
+	// Signals should be handled by threads of application, not by our flusher
+	sigset_t set, origset;
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &origset);
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, flusher, (void *)(intptr_t)tfd))
+		close(tfd);
+	else
+		__atomic_store_n(&flusher_running, true, __ATOMIC_RELAXED);
+	pthread_attr_destroy(&attr);
+	pthread_sigmask(SIG_SETMASK, &origset, NULL);
+}
+
+struct buffer *buffer_new(const struct output *out, bool timer) {
+	struct buffer *b = malloc(sizeof *b);
+	*b = (struct buffer){
+		.out = out,
+		.timer = timer,
+		.data = malloc(LOG_BUFFER_SIZE),
+	};
+	pthread_mutex_init(&b->mutex, NULL);
+
+	pthread_mutex_lock(&buffers_mutex);
+	b->next = buffers;
+	b->prev = &buffers;
+	if (buffers)
+		buffers->prev = &b->next;
+	buffers = b;
+	if (timer)
+		start_flusher();
+	pthread_mutex_unlock(&buffers_mutex);
+	errno = 0; // ignore possible timerfd failure
+	return b;
+}
+
+void buffer_free(struct buffer *b) {
+	if (b == NULL)
+		return;
+	pthread_mutex_lock(&buffers_mutex);
+	if (b->next)
+		b->next->prev = b->prev;
+	*b->prev = b->next;
+	pthread_mutex_unlock(&buffers_mutex);
+
+	flush_locked(b);
+	pthread_mutex_destroy(&b->mutex);
+	free(b->data);
+	free(b);
+}
+
+void buffer_write(struct buffer *b, const char *data, size_t len, bool urgent) {
+	if (b->timer && !__atomic_load_n(&flusher_running, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&buffers_mutex);
+		start_flusher();
+		pthread_mutex_unlock(&buffers_mutex);
+		errno = 0;
+	}
+	pthread_mutex_lock(&b->mutex);
+	if (b->len + len > LOG_BUFFER_SIZE)
+		flush_locked(b);
+	if (len > LOG_BUFFER_SIZE) {
+		// Line that does not fit to the buffer is written right away
+		lock_output(b->out);
+		output_write(b->out, data, len);
+		unlock_output(b->out);
+	} else {
+		memcpy(b->data + b->len, data, len);
+		b->len += len;
+		if (urgent || ++b->lines >= LOG_BUFFER_LINES)
+			flush_locked(b);
+	}
+	pthread_mutex_unlock(&b->mutex);
+}
+
+void buffer_flush(struct buffer *b) {
+	pthread_mutex_lock(&b->mutex);
+	flush_locked(b);
+	pthread_mutex_unlock(&b->mutex);
+}
@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_BUFFER_H_
+#define _LOGC_BUFFER_H_
+#include <stdbool.h>
+#include <stddef.h>
+
+struct output;
+
+// Buffer of output with LOG_F_BUFFER. Lines are collected and written together
+// once there is enough of them, on urgent line or on flush. Buffers with timer are
+// also flushed periodically by shared flusher thread.
+struct buffer;
+
+// Create buffer for given output. The output has to be valid for the lifetime of
+// buffer.
+struct buffer *buffer_new(const struct output *out, bool timer)
+	__attribute__((nonnull));
+// Write buffered lines and free buffer
+void buffer_free(struct buffer *b);
+
+// Add line to buffer. Urgent line is written right away together with all
+// buffered lines.
+void buffer_write(struct buffer *b, const char *data, size_t len, bool urgent)
+	__attribute__((nonnull));
+
+// Write buffered lines
+void buffer_flush(struct buffer *b) __attribute__((nonnull));
+
+#endif
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "callsite.h"
+#include <fnmatch.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+// Callsites of every module (binary or shared library) are in the section of
+// that module and thus we have to track them separately.
+struct callsites {
+	struct log_callsite *start, *stop;
+};
+static struct callsites *callsites = NULL;
+static size_t callsites_cnt = 0;
+
+// Rules are recorded so we can apply them to modules registered later on.
+struct rule {
+	char *file;
+	char *func;
+	unsigned line;
+	bool enable;
+};
+static struct rule *rules = NULL;
+static size_t rules_cnt = 0;
+
+// Callsites and rules are modified from constructors and destructors of modules
+// as well as by application
+static pthread_mutex_t callsites_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static bool rule_matches(const struct rule *rule, const struct log_callsite *cs) {
+	return (!rule->file || !fnmatch(rule->file, cs->file, 0)) &&
+		(!rule->func || !fnmatch(rule->func, cs->func, 0)) &&
+		(!rule->line || rule->line == cs->line);
+}
+
+static size_t rule_apply(const struct rule *rule, const struct callsites *sites) {
+	size_t cnt = 0;
+	for (struct log_callsite *cs = sites->start; cs < sites->stop; cs++) {
+		// Callsites of messages removed at compile time have no origin
+		if (cs->file == NULL || !rule_matches(rule, cs))
+			continue;
+		// Flags are read by logging threads
+		if (rule->enable)
+			__atomic_fetch_or(&cs->flags, LOG_CS_ENABLED, __ATOMIC_RELAXED);
+		else
+			__atomic_fetch_and(&cs->flags, ~LOG_CS_ENABLED, __ATOMIC_RELAXED);
+		cnt++;
+	}
+	return cnt;
+}
+
+void _logc_register_callsites(struct log_callsite *start, struct log_callsite *stop) {
+	if (start == NULL || start == stop)
+		return; // module without any message
+	pthread_mutex_lock(&callsites_mutex);
+	// Constructor is part of every compilation unit and thus we can get the same
+	// module multiple times.
+	for (size_t i = 0; i < callsites_cnt; i++)
+		if (callsites[i].start == start)
+			goto unlock;
+	struct callsites *new = realloc(callsites, (callsites_cnt + 1) * sizeof *callsites);
+	if (new == NULL) {
+		errno = 0; // messages of module just can't be enabled individually
+		goto unlock;
+	}
+	callsites = new;
+	callsites[callsites_cnt] = (struct callsites){.start = start, .stop = stop};
+	for (size_t i = 0; i < rules_cnt; i++)
+		rule_apply(&rules[i], &callsites[callsites_cnt]);
+	callsites_cnt++;
+unlock:
+	pthread_mutex_unlock(&callsites_mutex);
+}
+
+void _logc_unregister_callsites(struct log_callsite *start, struct log_callsite *stop) {
+	if (start == NULL || start == stop)
+		return;
+	pthread_mutex_lock(&callsites_mutex);
+	// Destructor is part of every compilation unit as well. Rendered origins are
+	// not freed as they can still be referenced by messages queued in
+	// asynchronous outputs or flight recorders.
+	for (size_t i = 0; i < callsites_cnt; i++)
+		if (callsites[i].start == start) {
+			callsites[i] = callsites[--callsites_cnt];
+			break;
+		}
+	pthread_mutex_unlock(&callsites_mutex);
+}
+
+size_t log_callsites_enable(const char *file, const char *func, unsigned line,
+		bool enable) {
+	struct rule rule = {
+		.file = file ? strdup(file) : NULL,
+		.func = func ? strdup(func) : NULL,
+		.line = line,
+		.enable = enable,
+	};
+	if ((file && rule.file == NULL) || (func && rule.func == NULL)) {
+		free(rule.file);
+		free(rule.func);
+		return 0;
+	}
+	pthread_mutex_lock(&callsites_mutex);
+	struct rule *new = realloc(rules, (rules_cnt + 1) * sizeof *rules);
+	if (new == NULL) {
+		pthread_mutex_unlock(&callsites_mutex);
+		free(rule.file);
+		free(rule.func);
+		return 0;
+	}
+	rules = new;
+	rules[rules_cnt++] = rule;
+	size_t cnt = 0;
+	for (size_t i = 0; i < callsites_cnt; i++)
+		cnt += rule_apply(&rule, &callsites[i]);
+	pthread_mutex_unlock(&callsites_mutex);
+	return cnt;
+}
+
+void log_callsites_foreach(void (*callback)(const struct log_callsite*, void*),
+		void *data) {
+	pthread_mutex_lock(&callsites_mutex);
+	for (size_t i = 0; i < callsites_cnt; i++)
+		for (struct log_callsite *cs = callsites[i].start; cs < callsites[i].stop; cs++)
+			if (cs->file)
+				callback(cs, data);
+	pthread_mutex_unlock(&callsites_mutex);
+}
+
+const char *callsite_origin(struct log_callsite *cs) {
+	char *origin = __atomic_load_n(&cs->origin, __ATOMIC_ACQUIRE);
+	if (origin == NULL) {
+		if (asprintf(&origin, "(%s:%u,%s)", cs->file, cs->line, cs->func) == -1)
+			origin = NULL;
+		errno = 0; // ignore possible allocation error and use fallback
+		// Other thread might have rendered it in the meantime
+		char *expected = NULL;
+		if (origin && !__atomic_compare_exchange_n(&cs->origin, &expected, origin,
+					false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			free(origin);
+			origin = expected;
+		}
+	}
+	return origin;
+}
@@ -0,0 +1,10 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_CALLSITE_H_
+#define _LOGC_CALLSITE_H_
+#include "log.h"
+
+// Provides origin "(file:line,func)" rendered once and cached in callsite.
+const char *callsite_origin(struct log_callsite *cs) __attribute__((nonnull));
+
+#endif
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef LOGC_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LOGC_ZSTD
+#include <zstd.h>
+#endif
+
+#define OPEN_FLAGS (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC)
+#define OPEN_MODE 0666
+
+// Lines are compressed in batches of this size
+#define BATCH_SIZE (64 * 1024)
+#define OUT_SIZE (16 * 1024)
+
+struct compress {
+	enum log_codec codec;
+	int fd;
+	unsigned interval;
+	pthread_mutex_t mutex;
+	bool frame_open;
+	time_t frame_start;
+	char *batch;
+	size_t batch_len;
+	char out[OUT_SIZE];
+#ifdef LOGC_ZLIB
+	z_stream z;
+#endif
+#ifdef LOGC_ZSTD
+	ZSTD_CCtx *zstd;
+#endif
+};
+
+static time_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ts.tv_sec;
+}
+
+__attribute__((unused)) // no codec might be compiled in
+static void write_all(int fd, const char *data, size_t len) {
+	while (len > 0) {
+		ssize_t res = write(fd, data, len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			break; // There is nothing we can do about it
+		}
+		data += res;
+		len -= res;
+	}
+}
+
+#ifdef LOGC_ZLIB
+static bool gzip_init(struct compress *c, int level) {
+	// Window bits over 15 select gzip wrapper
+	return deflateInit2(&c->z, level ?: Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+			Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+static void gzip_compress(struct compress *c, const char *data, size_t len, bool end) {
+	c->z.next_in = (Bytef *)data;
+	c->z.avail_in = len;
+	int res;
+	do {
+		c->z.next_out = (Bytef *)c->out;
+		c->z.avail_out = OUT_SIZE;
+		res = deflate(&c->z, end ? Z_FINISH : Z_NO_FLUSH);
+		write_all(c->fd, c->out, OUT_SIZE - c->z.avail_out);
+	} while (res == Z_OK && (c->z.avail_in || c->z.avail_out == 0 || end));
+	if (end)
+		deflateReset(&c->z); // Next data start new gzip member
+}
+#endif
+
+#ifdef LOGC_ZSTD
+static bool zstd_init(struct compress *c, int level) {
+	c->zstd = ZSTD_createCCtx();
+	if (c->zstd == NULL)
+		return false;
+	if (level)
+		ZSTD_CCtx_setParameter(c->zstd, ZSTD_c_compressionLevel, level);
+	return true;
+}
+
+static void zstd_compress(struct compress *c, const char *data, size_t len, bool end) {
+	ZSTD_inBuffer in = {.src = data, .size = len};
+	size_t remaining;
+	do {
+		ZSTD_outBuffer out = {.dst = c->out, .size = OUT_SIZE};
+		remaining = ZSTD_compressStream2(c->zstd, &out, &in,
+				end ? ZSTD_e_end : ZSTD_e_continue);
+		if (ZSTD_isError(remaining))
+			break;
+		write_all(c->fd, c->out, out.pos);
+	} while (end ? remaining != 0 : in.pos < in.size);
+}
+#endif
+
+static void compress_data(struct compress *c, const char *data, size_t len, bool end) {
+	switch (c->codec) {
+#ifdef LOGC_ZLIB
+		case LOG_CODEC_GZIP:
+			gzip_compress(c, data, len, end);
+			break;
+#endif
+#ifdef LOGC_ZSTD
+		case LOG_CODEC_ZSTD:
+			zstd_compress(c, data, len, end);
+			break;
+#endif
+		default:
+			break;
+	}
+	c->frame_open = !end;
+}
+
+// Compress batch and optionally close frame
+static void compress_batch(struct compress *c, bool end) {
+	if (!c->batch_len && !(end && c->frame_open))
+		return;
+	compress_data(c, c->batch, c->batch_len, end);
+	c->batch_len = 0;
+}
+
+struct compress *compress_new(const char *path, const struct log_compression *config) {
+	struct compress *c = malloc(sizeof *c);
+	*c = (struct compress){
+		.codec = config->codec,
+		.interval = config->frame_interval,
+	};
+	bool ok = false;
+	switch (config->codec) {
+#ifdef LOGC_ZLIB
+		case LOG_CODEC_GZIP:
+			ok = gzip_init(c, config->level);
+			break;
+#endif
+#ifdef LOGC_ZSTD
+		case LOG_CODEC_ZSTD:
+			ok = zstd_init(c, config->level);
+			break;
+#endif
+		default:
+			break;
+	}
+	if (!ok) {
+		free(c);
+		errno = ENOTSUP;
+		return NULL;
+	}
+	c->fd = open(path, OPEN_FLAGS, OPEN_MODE);
+	if (c->fd == -1) {
+		int err = errno;
+		compress_free(c);
+		errno = err;
+		return NULL;
+	}
+	c->batch = malloc(BATCH_SIZE);
+	pthread_mutex_init(&c->mutex, NULL);
+	return c;
+}
+
+void compress_free(struct compress *c) {
+	if (c == NULL)
+		return;
+	if (c->fd != -1) {
+		compress_batch(c, true);
+		pthread_mutex_destroy(&c->mutex);
+	}
+	switch (c->codec) {
+#ifdef LOGC_ZLIB
+		case LOG_CODEC_GZIP:
+			deflateEnd(&c->z);
+			break;
+#endif
+#ifdef LOGC_ZSTD
+		case LOG_CODEC_ZSTD:
+			ZSTD_freeCCtx(c->zstd);
+			break;
+#endif
+		default:
+			break;
+	}
+	free(c->batch);
+	free(c);
+}
+
+int compress_fd(const struct compress *c) {
+	return c->fd;
+}
+
+void compress_write(struct compress *c, const char *data, size_t len) {
+	pthread_mutex_lock(&c->mutex);
+	if (!c->frame_open) {
+		c->frame_start = now();
+		c->frame_open = true;
+	}
+	if (c->batch_len + len > BATCH_SIZE)
+		compress_batch(c, false);
+	if (len > BATCH_SIZE) {
+		// Line that does not fit to the batch is compressed right away
+		compress_data(c, data, len, false);
+	} else {
+		memcpy(c->batch + c->batch_len, data, len);
+		c->batch_len += len;
+	}
+	if (c->interval && now() - c->frame_start >= c->interval)
+		compress_batch(c, true);
+	pthread_mutex_unlock(&c->mutex);
+}
+
+void compress_flush(struct compress *c) {
+	pthread_mutex_lock(&c->mutex);
+	compress_batch(c, true);
+	pthread_mutex_unlock(&c->mutex);
+}
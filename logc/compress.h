@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_COMPRESS_H_
+#define _LOGC_COMPRESS_H_
+#include <logc.h>
+#include <stddef.h>
+
+// State of compressed file output (log_add_compressed_output). Lines are collected
+// to batch that is compressed once it is full. Compressed frames are closed
+// periodically so complete frames can be decompressed even if program crashes.
+struct compress;
+
+// Open file on given path for compressed output. Returns NULL and sets errno if
+// file can't be opened or codec is not supported.
+struct compress *compress_new(const char *path, const struct log_compression *config)
+	__attribute__((nonnull));
+// Compress all pending lines and close frame. File descriptor is not closed.
+void compress_free(struct compress *c);
+
+// File descriptor of output
+int compress_fd(const struct compress *c) __attribute__((nonnull));
+
+// Add line to output
+void compress_write(struct compress *c, const char *data, size_t len)
+	__attribute__((nonnull));
+
+// Compress all pending lines and close frame
+void compress_flush(struct compress *c) __attribute__((nonnull));
+
+#endif
@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "config.h"
+#include "level.h"
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+const struct log_config config_default = {
+	.level = DEF_LEVEL,
+	.dominator = NULL,
+	.outs = NULL,
+	.outs_cnt = 0,
+	.syslog_format = NULL,
+	.no_stderr = DEF_NO_STDERR,
+	.no_syslog = DEF_NO_SYSLOG,
+	.use_origin = DEF_USE_ORIGIN,
+	.sampling = {.mode = LOG_SAMPLE_ALL},
+};
+
+// Every thread that ever read configuration has its reader. The counter of reader
+// combines nesting of read sections (low bits) with grace period in which the
+// outermost section was entered (high bits). The counter is always updated with a
+// single store so the signal handler that interrupts update leaves it as it was.
+#define NEST_MASK 0xffffUL
+#define PERIOD_STEP (NEST_MASK + 1)
+
+struct reader {
+	unsigned long counter;
+	bool used;
+	struct reader *next;
+};
+
+// Readers are never freed, they are only released for reuse by other threads
+static struct reader *readers = NULL;
+static __thread struct reader *reader = NULL;
+static pthread_key_t reader_key;
+
+static unsigned long grace_period = PERIOD_STEP;
+
+// Modifications of configuration are serialized
+static pthread_mutex_t config_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void reader_release(void *data) {
+	struct reader *r = data;
+	__atomic_store_n(&r->counter, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&r->used, false, __ATOMIC_RELEASE);
+}
+
+static void atfork_prepare() {
+	pthread_mutex_lock(&config_mutex);
+}
+
+static void atfork_parent() {
+	pthread_mutex_unlock(&config_mutex);
+}
+
+static void atfork_child() {
+	pthread_mutex_unlock(&config_mutex);
+	// Other threads do not exist in child
+	for (struct reader *r = readers; r; r = r->next)
+		if (r != reader)
+			reader_release(r);
+}
+
+__attribute__((constructor))
+static void constructor() {
+	pthread_key_create(&reader_key, reader_release);
+	pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
+
+static struct reader *reader_register() {
+	struct reader *r;
+	for (r = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); r; r = r->next) {
+		bool expected = false;
+		if (!__atomic_load_n(&r->used, __ATOMIC_RELAXED) &&
+				__atomic_compare_exchange_n(&r->used, &expected, true, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+	if (r == NULL) {
+		r = calloc(1, sizeof *r);
+		r->used = true;
+		r->next = __atomic_load_n(&readers, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&readers, &r->next, r, true,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+	pthread_setspecific(reader_key, r);
+	return r;
+}
+
+void config_read_lock() {
+	if (reader == NULL)
+		reader = reader_register();
+	unsigned long counter = __atomic_load_n(&reader->counter, __ATOMIC_RELAXED);
+	if (counter & NEST_MASK)
+		__atomic_store_n(&reader->counter, counter + 1, __ATOMIC_RELAXED);
+	else
+		__atomic_store_n(&reader->counter,
+				__atomic_load_n(&grace_period, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void config_read_unlock() {
+	unsigned long counter = __atomic_load_n(&reader->counter, __ATOMIC_RELAXED);
+	__atomic_store_n(&reader->counter, counter - 1, __ATOMIC_RELEASE);
+}
+
+// Wait for all readers that entered read section before new grace period
+static void synchronize() {
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	unsigned long period = __atomic_add_fetch(&grace_period, PERIOD_STEP, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (struct reader *r = __atomic_load_n(&readers, __ATOMIC_ACQUIRE); r; r = r->next) {
+		while (true) {
+			unsigned long counter = __atomic_load_n(&r->counter, __ATOMIC_ACQUIRE);
+			if (!(counter & NEST_MASK) || (counter & ~NEST_MASK) == period)
+				break;
+			sched_yield();
+		}
+	}
+}
+
+struct log_config *config_edit(log_t log) {
+	pthread_mutex_lock(&config_mutex);
+	if (log->_log == NULL) {
+		struct _log *_log = malloc(sizeof *_log);
+		*_log = (struct _log){
+			.threshold = {.value = 0},
+			.config = (struct log_config *)&config_default,
+		};
+		__atomic_store_n(&log->_log, _log, __ATOMIC_RELEASE);
+	}
+	const struct log_config *current = log->_log->config;
+	struct log_config *config = malloc(sizeof *config);
+	*config = *current;
+	config->outs = NULL;
+	if (current->outs_cnt) {
+		config->outs = malloc(current->outs_cnt * sizeof *config->outs);
+		memcpy(config->outs, current->outs, current->outs_cnt * sizeof *config->outs);
+	}
+	return config;
+}
+
+void config_commit(log_t log, struct log_config *config) {
+	struct log_config *old = log->_log->config;
+	__atomic_store_n(&log->_log->config, config, __ATOMIC_RELEASE);
+	log_config_changed();
+	synchronize();
+	config_free(old);
+	pthread_mutex_unlock(&config_mutex);
+}
+
+struct log_config *config_remove(log_t log) {
+	pthread_mutex_lock(&config_mutex);
+	struct _log *_log = log->_log;
+	if (_log == NULL) {
+		pthread_mutex_unlock(&config_mutex);
+		return NULL;
+	}
+	__atomic_store_n(&log->_log, NULL, __ATOMIC_RELEASE);
+	log_config_changed();
+	synchronize();
+	struct log_config *config = _log->config;
+	free(_log);
+	pthread_mutex_unlock(&config_mutex);
+	if (config == &config_default)
+		return NULL;
+	return config;
+}
+
+void config_free(struct log_config *config) {
+	if (config == NULL || config == &config_default)
+		return;
+	free(config->outs);
+	free(config);
+}
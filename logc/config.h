@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_CONFIG_H_
+#define _LOGC_CONFIG_H_
+#include "log.h"
+
+// Configuration of logs is read without any locking. Readers have to only mark
+// section in which they access it. Configuration is replaced as a whole and the
+// old one is freed only once there is no reader that could have seen it.
+
+// Configuration used by logs that were not configured yet
+extern const struct log_config config_default;
+
+// Mark section in which configuration is accessed. These can be nested and used
+// in signal handlers as well.
+void config_read_lock();
+void config_read_unlock();
+
+// Get current configuration of log. This has to be called in read section and
+// returned configuration is valid only until the end of that section.
+static inline const struct log_config *log_config(log_t log) {
+	struct _log *_log = __atomic_load_n(&log->_log, __ATOMIC_ACQUIRE);
+	return _log ? __atomic_load_n(&_log->config, __ATOMIC_ACQUIRE) : &config_default;
+}
+
+// Start modification of log's configuration. Modifications are serialized and
+// the copy of current configuration is returned for modification. The outs array
+// is copied as well but not the outputs nor the syslog format.
+// You have to call config_commit to finish the modification.
+struct log_config *config_edit(log_t log) __attribute__((nonnull));
+
+// Replace configuration of log with provided one. This waits for all readers that
+// could have seen the previous configuration. Outputs and syslog format that were
+// removed from configuration can be freed once this returns.
+void config_commit(log_t log, struct log_config *config) __attribute__((nonnull));
+
+// Remove all configuration of log. The removed configuration is returned and you
+// have to free outputs and syslog format and then call config_free on it. NULL
+// is returned if log has no configuration.
+struct log_config *config_remove(log_t log) __attribute__((nonnull));
+
+// Free configuration (but not outputs nor syslog format)
+void config_free(struct log_config *config);
+
+// Check if syslog should be used with given configuration
+static inline bool config_syslog(log_t log, const struct log_config *config) {
+	return (!config->no_syslog && log->daemon) || config->syslog_format;
+}
+
+#endif
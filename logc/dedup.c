@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "dedup.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "log.h"
+#include "format.h"
+#include "timestamp.h"
+
+// FNV-1a
+#define HASH_OFFSET 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+static uint64_t hash_data(uint64_t hash, const void *data, size_t len) {
+	const unsigned char *d = data;
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ d[i]) * HASH_PRIME;
+	return hash;
+}
+
+// Strings are hashed including terminating null byte so fields can't be shifted
+static uint64_t hash_str(uint64_t hash, const char *str) {
+	return hash_data(hash, str ?: "", str ? strlen(str) + 1 : 1);
+}
+
+unsigned long dedup_hash(enum log_message_level level, const char *name,
+		const char *msg, size_t len, const char *err) {
+	uint64_t hash = hash_data(HASH_OFFSET, &level, sizeof level);
+	hash = hash_str(hash, name);
+	hash = hash_data(hash, msg, len);
+	hash = hash_str(hash, err);
+	unsigned long folded = hash;
+	if (sizeof folded < sizeof hash)
+		folded ^= hash >> 32;
+	return folded ?: 1; // zero is reserved for no message
+}
+
+bool dedup_record(struct dedup *dedup, unsigned long hash, enum log_message_level level,
+		const char *name, struct dedup_summary *summary) {
+	unsigned long prev = __atomic_exchange_n(&dedup->hash, hash, __ATOMIC_ACQ_REL);
+	if (prev == hash) {
+		__atomic_add_fetch(&dedup->repeated, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	summary->level = __atomic_load_n(&dedup->level, __ATOMIC_RELAXED);
+	summary->name = __atomic_load_n(&dedup->name, __ATOMIC_RELAXED);
+	summary->repeated = __atomic_exchange_n(&dedup->repeated, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&dedup->level, level, __ATOMIC_RELAXED);
+	__atomic_store_n(&dedup->name, name, __ATOMIC_RELAXED);
+	return true;
+}
+
+bool dedup_take(struct dedup *dedup, struct dedup_summary *summary) {
+	summary->repeated = __atomic_exchange_n(&dedup->repeated, 0, __ATOMIC_RELAXED);
+	summary->level = __atomic_load_n(&dedup->level, __ATOMIC_RELAXED);
+	summary->name = __atomic_load_n(&dedup->name, __ATOMIC_RELAXED);
+	return summary->repeated != 0;
+}
+
+void dedup_render(struct record *r, const struct output *out,
+		const struct dedup_summary *summary, struct log_time *time) {
+	char msg[64];
+	int len = snprintf(msg, sizeof msg, "last message repeated %zu times",
+			summary->repeated);
+	bool has_name = summary->name && *summary->name;
+	render_line(r, out, summary->level, has_name ? summary->name : NULL, "", 0, "",
+			NULL, false, FM_MESSAGE | (has_name ? FM_NAME : 0), NULL, time, 1, msg, len);
+}
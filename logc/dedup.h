@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_DEDUP_H_
+#define _LOGC_DEDUP_H_
+#include <logc.h>
+#include "record.h"
+
+// Suppression of consecutive identical messages of output (LOG_F_DEDUP). Messages
+// are compared by hash of their level, log name, message and error.
+struct dedup {
+	unsigned long hash; // of the last message (zero if there was none)
+	size_t repeated; // number of suppressed repetitions of the last message
+	enum log_message_level level; // of the last message
+	const char *name; // log name of the last message
+};
+
+// Summary of repeated message
+struct dedup_summary {
+	size_t repeated;
+	enum log_message_level level;
+	const char *name;
+};
+
+// Hash is folded to machine word so it can be exchanged atomically without
+// libatomic.
+unsigned long dedup_hash(enum log_message_level level, const char *name,
+		const char *msg, size_t len, const char *err) __attribute__((nonnull(3)));
+
+// Record message with given hash. Returns false if it is repetition of the
+// previous message and thus should be suppressed. Otherwise summary of the
+// previous message is provided (it has zero repeated if it was not repeated).
+bool dedup_record(struct dedup *dedup, unsigned long hash, enum log_message_level level,
+		const char *name, struct dedup_summary *summary) __attribute__((nonnull(1, 5)));
+
+// Take summary of repetitions not reported so far. Returns false if there are none.
+bool dedup_take(struct dedup *dedup, struct dedup_summary *summary)
+	__attribute__((nonnull));
+
+struct output;
+struct log_time;
+
+// Render summary line for given output to the record
+void dedup_render(struct record *r, const struct output *out,
+		const struct dedup_summary *summary, struct log_time *time)
+	__attribute__((nonnull));
+
+#endif
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "deferred.h"
+#include "log.h"
+#include "output.h"
+#include "spec.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define APPEND(R, VALUE) record_append((R), (const char *)&(VALUE), sizeof(VALUE))
+
+bool deferred_capture(struct record *r, const struct deferred *header,
+		const char *name, const char *format, va_list args) {
+	r->len = 0;
+	APPEND(r, *header);
+	record_append(r, name, strlen(name) + 1);
+	record_append(r, format, strlen(format) + 1);
+
+	for (const char *c = strchr(format, '%'); c; c = strchr(c, '%')) {
+		struct spec spec;
+		if (!parse_spec(c, &spec))
+			return false;
+		c += spec.len;
+		int precision = spec.precision;
+		if (spec.width_arg) {
+			int width = va_arg(args, int);
+			APPEND(r, width);
+		}
+		if (spec.precision_arg) {
+			precision = va_arg(args, int);
+			APPEND(r, precision);
+		}
+
+#define CAPTURE(TYPE) do { \
+			TYPE value = va_arg(args, TYPE); \
+			APPEND(r, value); \
+		} while (false)
+		switch (spec.type) {
+			case AT_NONE:
+				break;
+			case AT_INT:
+				CAPTURE(int);
+				break;
+			case AT_LONG:
+				CAPTURE(long);
+				break;
+			case AT_LLONG:
+				CAPTURE(long long);
+				break;
+			case AT_INTMAX:
+				CAPTURE(intmax_t);
+				break;
+			case AT_SIZE:
+				CAPTURE(size_t);
+				break;
+			case AT_PTRDIFF:
+				CAPTURE(ptrdiff_t);
+				break;
+			case AT_DOUBLE:
+				CAPTURE(double);
+				break;
+			case AT_LDOUBLE:
+				CAPTURE(long double);
+				break;
+			case AT_PTR:
+				CAPTURE(void *);
+				break;
+			case AT_STR: {
+				// The string does not have to be terminated if precision is
+				// specified so we copy only what would be printed.
+				const char *str = va_arg(args, const char *);
+				char is_null = str == NULL;
+				APPEND(r, is_null);
+				if (str) {
+					size_t len = precision >= 0 ? strnlen(str, precision) : strlen(str);
+					record_append(r, str, len);
+					record_append(r, "", 1);
+				}
+				break;
+			}
+		}
+#undef CAPTURE
+	}
+	return true;
+}
+
+// Copy captured value out of arguments. Returns false if arguments are too short.
+static bool take(const char **args, const char *end, void *value, size_t size) {
+	if ((size_t)(end - *args) < size)
+		return false;
+	memcpy(value, *args, size);
+	*args += size;
+	return true;
+}
+
+// Take null terminated string from data. Returns NULL if it is not terminated
+// before end.
+static const char *take_str(const char **data, const char *end) {
+	const char *str = *data;
+	size_t len = strnlen(str, end - str);
+	if (len == (size_t)(end - str))
+		return NULL;
+	*data += len + 1;
+	return str;
+}
+
+// Build specification with widths and precisions passed as arguments replaced by
+// captured values.
+static bool build_spec(char *buf, const char *str, const struct spec *spec,
+		const char **args, const char *end) {
+	int width = 0, precision = -1;
+	if (spec->width_arg && !take(args, end, &width, sizeof width))
+		return false;
+	if (spec->precision_arg && !take(args, end, &precision, sizeof precision))
+		return false;
+	spec_build(buf, str, spec, width, precision, NULL);
+	return true;
+}
+
+// Render message from format and captured arguments. Returns false if captured
+// arguments do not match format.
+static bool render_message(struct record *r, const char *format, const char *args,
+		const char *end) {
+	const char *c = format;
+	while (true) {
+		const char *next = strchr(c, '%');
+		if (next == NULL) {
+			record_puts(r, c);
+			return true;
+		}
+		record_append(r, c, next - c);
+		struct spec spec;
+		char buf[SPEC_BUF_SIZE];
+		if (!parse_spec(next, &spec) || !build_spec(buf, next, &spec, &args, end))
+			return false;
+		c = next + spec.len;
+
+#define RENDER(TYPE) do { \
+			TYPE value; \
+			if (!take(&args, end, &value, sizeof value)) \
+				return false; \
+			record_printf(r, buf, value); \
+		} while (false)
+		switch (spec.type) {
+			case AT_NONE:
+				record_append(r, "%", 1);
+				break;
+			case AT_INT:
+				RENDER(int);
+				break;
+			case AT_LONG:
+				RENDER(long);
+				break;
+			case AT_LLONG:
+				RENDER(long long);
+				break;
+			case AT_INTMAX:
+				RENDER(intmax_t);
+				break;
+			case AT_SIZE:
+				RENDER(size_t);
+				break;
+			case AT_PTRDIFF:
+				RENDER(ptrdiff_t);
+				break;
+			case AT_DOUBLE:
+				RENDER(double);
+				break;
+			case AT_LDOUBLE:
+				RENDER(long double);
+				break;
+			case AT_PTR:
+				RENDER(void *);
+				break;
+			case AT_STR: {
+				char is_null;
+				if (!take(&args, end, &is_null, sizeof is_null))
+					return false;
+				const char *str = NULL;
+				if (!is_null && (str = take_str(&args, end)) == NULL)
+					return false;
+				record_printf(r, buf, str);
+				break;
+			}
+		}
+#undef RENDER
+	}
+}
+
+bool deferred_render(struct record *r, const struct output *out,
+		const char *data, size_t len) {
+	struct deferred header;
+	if (len < sizeof header)
+		return false;
+	memcpy(&header, data, sizeof header);
+	const char *end = data + len;
+	const char *args = data + sizeof header;
+	const char *name = take_str(&args, end);
+	const char *format = name ? take_str(&args, end) : NULL;
+	if (format == NULL)
+		return false;
+
+	struct record msg;
+	record_init(&msg);
+	bool valid = render_message(&msg, format, args, end);
+	if (valid) {
+		unsigned present = header.present | (msg.len ? FM_MESSAGE : 0);
+		render_line(r, out, header.level, name, header.file, header.line, header.func,
+				header.origin, header.use_origin, present,
+				header.stderrno ? strerror(header.stderrno) : NULL, &header.time,
+				header.sample_rate, msg.data, msg.len);
+	}
+	record_free(&msg);
+	return valid;
+}
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_DEFERRED_H_
+#define _LOGC_DEFERRED_H_
+#include <logc.h>
+#include <stdarg.h>
+#include "record.h"
+#include "timestamp.h"
+
+struct output;
+
+// Message captured for formatting in writer thread of asynchronous output. It is
+// followed by log name, message format (both including terminating null byte) and
+// captured arguments. Nothing is aligned and thus it has to be always copied out.
+struct deferred {
+	enum log_message_level level;
+	unsigned present; // fields present in message except of FM_MESSAGE
+	int stderrno;
+	bool use_origin;
+	const char *file;
+	size_t line;
+	const char *func;
+	const char *origin;
+	struct log_time time; // frozen time of the message
+	unsigned sample_rate;
+};
+
+// Capture message to record. Arguments are stored in binary form and strings are
+// copied. Returns false if format contains conversion that can't be deferred
+// (such as %n, %m or positional arguments) and message has to be formatted right
+// away.
+bool deferred_capture(struct record *r, const struct deferred *header,
+		const char *name, const char *format, va_list args)
+	__attribute__((nonnull(1, 2, 3, 4)));
+
+// Render log line for given output from message captured by deferred_capture.
+// Returns false and renders nothing if data is not valid captured message.
+bool deferred_render(struct record *r, const struct output *out,
+		const char *data, size_t len) __attribute__((nonnull));
+
+#endif
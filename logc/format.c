@@ -2,57 +2,317 @@
 // Copyright 2020, CZ.NIC z.s.p.o. (http://www.nic.cz/)
 #include "format.h"
 #include <string.h>
+#include <pthread.h>
+#include "timestamp.h"
 
 #include "format.gperf.h"
 
+// The common origin sequence is replaced with single field so we can use origin
+// cached in message callsite.
+#define ORIGIN_SEQ "(%f:%i,%c)"
+#define ORIGIN_SEQ_LEN (sizeof(ORIGIN_SEQ) - 1)
+
+// Nesting of conditions during compilation
+struct block {
+	size_t if_op;
+	size_t else_op;
+	size_t last_child;
+};
+
+struct compile {
+	struct format_op *ops;
+	size_t cnt, size;
+	char *text;
+	size_t text_len, text_size;
+	struct block *blocks;
+	size_t depth, blocks_size;
+	bool text_open; // last instruction is text we can append to
+};
+
+#define GROW(ARRAY, SIZE, CNT) do { \
+		if ((CNT) >= (SIZE)) { \
+			SIZE = (SIZE) ? 2 * (SIZE) : 8; \
+			ARRAY = realloc(ARRAY, (SIZE) * sizeof *(ARRAY)); \
+		} \
+	} while (false)
+
+static unsigned field_mask(enum format_fields type) {
+	switch (type) {
+		case FF_MESSAGE:
+			return FM_MESSAGE;
+		case FF_NAME:
+			return FM_NAME;
+		case FF_SOURCE_FILE:
+		case FF_SOURCE_LINE:
+		case FF_SOURCE_FUNC:
+		case FF_ORIGIN:
+			return FM_ORIGIN;
+		case FF_STD_ERR:
+			return FM_STD_ERR;
+		case FF_TIME_ISO:
+		case FF_TIME_UTC:
+		case FF_TIME_ZONE:
+		case FF_TIME_RFC3339:
+		case FF_TIME_EPOCH:
+		case FF_TIME_MONO:
+		case FF_TIME_ELAPSED:
+		case FF_TIME_FRAC:
+			return FM_TIME;
+		case FF_SAMPLE_RATE:
+			return FM_SAMPLED;
+		default:
+			return 0;
+	}
+}
+
+static void add_text(struct compile *c, const char *text, size_t len) {
+	if (c->text_open) {
+		c->ops[c->cnt - 1].len += len; // merge with previous text
+	} else {
+		GROW(c->ops, c->size, c->cnt);
+		// Text pointer is offset in the text buffer until it is finalized
+		c->ops[c->cnt++] = (struct format_op){
+			.type = FF_TEXT,
+			.text = (const char *)c->text_len,
+			.len = len,
+		};
+		c->text_open = true;
+	}
+	while (c->text_len + len > c->text_size) {
+		c->text_size = c->text_size ? 2 * c->text_size : 64;
+		c->text = realloc(c->text, c->text_size);
+	}
+	memcpy(c->text + c->text_len, text, len);
+	c->text_len += len;
+}
+
+static void add_op(struct compile *c, const struct format_op *op) {
+	struct block *block = c->depth ? &c->blocks[c->depth - 1] : NULL;
+	c->text_open = false;
+	switch (op->type) {
+		case FF_IF:
+			break;
+		case FF_ELSE:
+			if (block == NULL || block->else_op)
+				return; // else outside of condition or second else is ignored
+			block->else_op = c->cnt;
+			c->ops[block->if_op].has_else = true;
+			c->ops[block->if_op].jump = c->cnt + 1;
+			break;
+		case FF_IFEND:
+			if (block == NULL)
+				return; // end of condition outside of any is ignored
+			c->depth--;
+			if (block->else_op)
+				c->ops[block->else_op].jump = c->cnt;
+			else
+				c->ops[block->if_op].jump = c->cnt;
+			return; // There is no need for instruction
+		default:
+			if (block && !block->else_op)
+				c->ops[block->if_op].fields |= field_mask(op->type);
+			break;
+	}
+
+	GROW(c->ops, c->size, c->cnt);
+	c->ops[c->cnt] = *op;
+	if (op->type == FF_IF) {
+		if (block && !block->else_op) {
+			if (block->last_child)
+				c->ops[block->last_child].sibling = c->cnt;
+			else
+				c->ops[block->if_op].child = c->cnt;
+			block->last_child = c->cnt;
+		}
+		GROW(c->blocks, c->blocks_size, c->depth);
+		c->blocks[c->depth++] = (struct block){.if_op = c->cnt};
+	}
+	c->cnt++;
+}
+
+// Terminate compilation and create format
+static struct format *finish(struct compile *c) {
+	// Unterminated conditions are terminated at the end of format
+	while (c->depth)
+		add_op(c, &(struct format_op){.type = FF_IFEND});
+
+	struct format *res = malloc(sizeof *res + c->cnt * sizeof *c->ops + c->text_len);
+	res->cnt = c->cnt;
+	char *text = (char *)(res->ops + c->cnt);
+	memcpy(text, c->text, c->text_len);
+	for (size_t i = 0; i < c->cnt; i++) {
+		res->ops[i] = c->ops[i];
+		if (res->ops[i].type == FF_TEXT)
+			res->ops[i].text = text + (size_t)res->ops[i].text;
+	}
+	free(c->ops);
+	free(c->text);
+	free(c->blocks);
+	return res;
+}
+
 struct format *parse_format(const char *format) {
-	struct format *first = NULL;
-	struct format *f;
+	struct compile c = {0};
 	while (*format != '\0') {
-		struct format *new = malloc(sizeof *new);
-		bool plain_text = true;
+		if (!strncmp(format, ORIGIN_SEQ, ORIGIN_SEQ_LEN)) {
+			add_op(&c, &(struct format_op){.type = FF_ORIGIN});
+			format += ORIGIN_SEQ_LEN;
+			continue;
+		}
 		if (*format == '%') {
 			format++;
 			const struct gperf_format *fg;
 			size_t len = 0;
 			do fg = gperf_format(format, ++len); while (!fg && len <= 2);
 			if (fg != NULL) {
-				*new = fg->f;
+				add_op(&c, &fg->op);
 				format += len;
-				plain_text = false;
+				continue;
 			}
 			// Note: if fd == NULL then we eat up %
+			if (*format == '\0')
+				break;
 		}
-		if (plain_text) {
-			// First character is not considered as if it is % it was already detected
-			const char *next = strchrnul(format + 1, '%');
-			*new = (struct format){
-				.type = FF_TEXT,
-				.text = strndup(format, next - format),
-			};
-			format = next;
-		}
-		if (first)
-			f->next = new;
-		else
-			first = new;
-		f = new;
+		// First character is not considered as if it is % it was already detected
+		const char *next = strchrnul(format + 1, '%');
+		const char *origin = strstr(format + 1, ORIGIN_SEQ);
+		if (origin && origin < next)
+			next = origin;
+		add_text(&c, format, next - format);
+		format = next;
 	}
-	return first;
+	return finish(&c);
 }
 
 void free_format(struct format *f) {
-	while (f) {
-		struct format *tmp = f;
-		f = f->next;
-		free(tmp->text);
-		free(tmp);
+	free(f);
+}
+
+bool format_condition(const struct format *format, size_t i,
+		enum log_message_level level, bool is_term, bool colors, unsigned present) {
+	const struct format_op *op = &format->ops[i];
+	bool res = false;
+	switch (op->condition) {
+		case FIFC_NON_EMPTY:
+			if (op->fields & (present | FM_TIME))
+				return true;
+			// Any fulfilled condition (or one with else) is considered non-empty
+			for (size_t c = op->child; c; c = format->ops[c].sibling)
+				if (format->ops[c].has_else ||
+						format_condition(format, c, level, is_term, colors, present))
+					return true;
+			return false;
+		case FIFC_LEVEL:
+			res = level >= op->if_level;
+			break;
+		case FIFC_TERMINAL:
+			res = is_term;
+			break;
+		case FIFC_COLORED:
+			res = colors;
+			break;
+	}
+	return res != op->if_invert;
+}
+
+// Check if condition is known to be fulfilled without knowing the message
+static bool static_condition(const struct format *format, size_t i,
+		enum log_message_level level, bool is_term, bool colors) {
+	const struct format_op *op = &format->ops[i];
+	if (op->condition != FIFC_NON_EMPTY)
+		return format_condition(format, i, level, is_term, colors, 0);
+	if (op->fields & FM_TIME)
+		return true;
+	for (size_t c = op->child; c; c = format->ops[c].sibling)
+		if (format->ops[c].has_else ||
+				static_condition(format, c, level, is_term, colors))
+			return true;
+	return false;
+}
+
+// Copy instructions from given range while resolving static conditions
+static void specialize(struct compile *c, const struct format *format,
+		size_t from, size_t to, enum log_message_level level, bool is_term,
+		bool colors) {
+	for (size_t i = from; i < to; i++) {
+		const struct format_op *op = &format->ops[i];
+		if (op->type == FF_TEXT) {
+			add_text(c, op->text, op->len);
+			continue;
+		}
+		if (op->type != FF_IF) {
+			add_op(c, op);
+			continue;
+		}
+
+		size_t then_end = op->has_else ? op->jump - 1 : op->jump;
+		size_t else_end = op->has_else ? format->ops[then_end].jump : op->jump;
+		if (static_condition(format, i, level, is_term, colors)) {
+			specialize(c, format, i + 1, then_end, level, is_term, colors);
+		} else if (op->condition != FIFC_NON_EMPTY) {
+			specialize(c, format, then_end + 1, else_end, level, is_term, colors);
+		} else {
+			add_op(c, &(struct format_op){
+				.type = FF_IF,
+				.condition = op->condition,
+				.if_invert = op->if_invert,
+			});
+			specialize(c, format, i + 1, then_end, level, is_term, colors);
+			if (op->has_else) {
+				add_op(c, &(struct format_op){.type = FF_ELSE});
+				specialize(c, format, then_end + 1, else_end, level, is_term, colors);
+			}
+			add_op(c, &(struct format_op){.type = FF_IFEND});
+		}
+		i = else_end - 1;
 	}
 }
 
+// Clocks needed to render given field
+static unsigned field_clocks(enum format_fields type) {
+	switch (type) {
+		case FF_TIME_ISO:
+		case FF_TIME_UTC:
+		case FF_TIME_ZONE:
+		case FF_TIME_RFC3339:
+		case FF_TIME_EPOCH:
+		case FF_TIME_FRAC:
+			return LT_REAL;
+		case FF_TIME_MONO:
+		case FF_TIME_ELAPSED:
+			return LT_MONO;
+		default:
+			return 0;
+	}
+}
+
+void format_set_init(struct format_set *set, const struct format *format,
+		bool is_term, bool colors) {
+	set->clocks = 0;
+	for (size_t i = 0; i < format->cnt; i++)
+		set->clocks |= field_clocks(format->ops[i].type);
+	for (int l = LL_TRACE; l <= LL_CRITICAL; l++) {
+		struct compile c = {0};
+		specialize(&c, format, 0, format->cnt, l, is_term, colors);
+		set->levels[l - LL_TRACE] = finish(&c);
+	}
+}
+
+void format_set_free(struct format_set *set) {
+	if (set == NULL)
+		return;
+	for (size_t i = 0; i < FORMAT_LEVELS; i++)
+		free_format(set->levels[i]);
+}
+
+static struct format *default_format_parsed = NULL;
+static pthread_once_t default_format_once = PTHREAD_ONCE_INIT;
+
+static void default_format_init() {
+	default_format_parsed = parse_format(LOG_FORMAT_DEFAULT);
+}
+
 const struct format *default_format() {
-	static struct format *format = NULL;
-	if (format == NULL)
-		format = parse_format(LOG_FORMAT_DEFAULT);
-	return format;
+	pthread_once(&default_format_once, default_format_init);
+	return default_format_parsed;
 }
@@ -12,7 +12,17 @@ enum format_fields {
 	FF_SOURCE_FILE,
 	FF_SOURCE_LINE,
 	FF_SOURCE_FUNC,
+	FF_ORIGIN, // Combination of the source fields: (%f:%i,%c)
 	FF_STD_ERR,
+	FF_TIME_ISO, // local date and time
+	FF_TIME_UTC, // UTC date and time
+	FF_TIME_ZONE, // offset of local time from UTC
+	FF_TIME_RFC3339, // local date and time with microseconds and offset
+	FF_TIME_EPOCH, // seconds since epoch
+	FF_TIME_MONO, // seconds of monotonic clock
+	FF_TIME_ELAPSED, // seconds since program start
+	FF_TIME_FRAC, // fraction of second of previous time field (len is digits)
+	FF_SAMPLE_RATE,
 	FF_IF,
 	FF_ELSE,
 	FF_IFEND,
@@ -25,22 +35,71 @@ enum format_if_condition {
 	FIFC_COLORED,
 };
 
-struct format {
+// Mask of fields used for non-empty condition
+#define FM_MESSAGE (1 << 0)
+#define FM_NAME (1 << 1)
+#define FM_ORIGIN (1 << 2)
+#define FM_STD_ERR (1 << 3)
+#define FM_TIME (1 << 4) // time is always present
+#define FM_SAMPLED (1 << 5)
+
+// Single instruction of compiled format
+struct format_op {
 	enum format_fields type;
 
-	char *text;
+	// FF_TEXT
+	const char *text;
+	size_t len;
 
+	// FF_IF
 	enum format_if_condition condition;
 	bool if_invert;
 	enum log_message_level if_level;
+	bool has_else;
+	unsigned fields; // FM_* of fields directly in the block (FIFC_NON_EMPTY)
+	size_t child; // first condition directly in the block (zero if none)
+	size_t sibling; // next condition in the same block as this one
+
+	// FF_IF and FF_ELSE: index of instruction to continue with if condition is
+	// not fulfilled or at the end of fulfilled block respectively.
+	size_t jump;
+};
 
-	struct format *next;
+// Format compiled to continuous array of instructions. Text is stored in the same
+// allocation right after instructions.
+struct format {
+	size_t cnt;
+	struct format_op ops[];
 };
 
 
-struct format *parse_format(const char *format);
+struct format *parse_format(const char *format) __attribute__((nonnull));
 void free_format(struct format *f);
 
+// Check if condition of FF_IF instruction on given index is fulfilled.
+// The present is mask of FM_* fields that are not empty.
+bool format_condition(const struct format *format, size_t i,
+		enum log_message_level level, bool is_term, bool colors, unsigned present);
+
 const struct format *default_format();
 
+
+#define FORMAT_LEVELS (LL_CRITICAL - LL_TRACE + 1)
+
+// Format specialized for every message level and given output. Only conditions
+// on content of message are left in these.
+struct format_set {
+	struct format *levels[FORMAT_LEVELS];
+	unsigned clocks; // LT_* of clocks used by format
+};
+
+void format_set_init(struct format_set *set, const struct format *format,
+		bool is_term, bool colors) __attribute__((nonnull));
+void format_set_free(struct format_set *set);
+
+static inline const struct format *format_set_get(const struct format_set *set,
+		enum log_message_level level) {
+	return set->levels[level - LL_TRACE];
+}
+
 #endif
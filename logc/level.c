@@ -1,9 +1,14 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // Copyright 2020, CZ.NIC z.s.p.o. (http://www.nic.cz/)
 #include "level.h"
+#include "config.h"
+#include <limits.h>
 
 #define ENV_LOG_LEVEL_VAR "LOG_LEVEL"
 
+unsigned _logc_generation = 1;
+struct _log_threshold _logc_default_threshold = {.value = 0};
+
 static int log_level_from_env() {
 	static int level = 0;
 	static bool loaded = false;
@@ -16,36 +21,125 @@ static int log_level_from_env() {
 	return level;
 }
 
-bool verbose_filter(int level, log_t log, const struct output *out) {
-	return level - 
-		(log->_log ? log->_log->level : 0) -
+bool verbose_filter(int level, const struct log_config *config,
+		const struct output *out) {
+	return level -
+		config->level -
 		(out ? out->level : 0) -
 		log_level_from_env()
 		>= 0;
 }
 
+static int calculate_threshold(log_t log) {
+	int level = log_level_from_env();
+	const struct log_config *config = log_config(log);
+	while (config->dominator) {
+		level += config->level;
+		log = config->dominator;
+		config = log_config(log);
+	}
+
+	level += config->level;
+	int out_level = INT_MAX;
+	if (config->outs_cnt) {
+		for (size_t i = 0; i < config->outs_cnt; i++)
+			if (config->outs[i]->level < out_level)
+				out_level = config->outs[i]->level;
+	} else if (!config->no_stderr)
+		out_level = 0;
+	if (config_syslog(log, config) && out_level > 0)
+		out_level = 0;
+
+	return out_level == INT_MAX ? INT_MAX : level + out_level;
+}
+
+// Generation as stored in packed threshold
+static unsigned threshold_generation(unsigned generation) {
+	return generation << _LOGC_THRESHOLD_GENERATION_SHIFT >>
+		_LOGC_THRESHOLD_GENERATION_SHIFT;
+}
+
+static unsigned pack_threshold(unsigned generation, int level, bool recorder) {
+	// Messages are clamped to LL_TRACE..LL_CRITICAL so wider range is not needed
+	if (level < LL_TRACE)
+		level = LL_TRACE;
+	if (level > LL_CRITICAL + 1)
+		level = LL_CRITICAL + 1;
+	return generation << _LOGC_THRESHOLD_GENERATION_SHIFT |
+		(recorder ? _LOGC_THRESHOLD_RECORDER : 0) | (unsigned)(level - LL_TRACE);
+}
+
+// Packed threshold of log that is up to date. Logs that were never configured
+// share the default one as their threshold depends only on environment.
+static unsigned cached_threshold(log_t log) {
+	unsigned generation = threshold_generation(
+			__atomic_load_n(&_logc_generation, __ATOMIC_ACQUIRE));
+	struct _log *_log = __atomic_load_n(&log->_log, __ATOMIC_ACQUIRE);
+	struct _log_threshold *cache = _log ? &_log->threshold : &_logc_default_threshold;
+	// Up to date threshold is used without entering read section of configuration
+	unsigned threshold = __atomic_load_n(&cache->value, __ATOMIC_ACQUIRE);
+	if (threshold >> _LOGC_THRESHOLD_GENERATION_SHIFT == generation)
+		return threshold;
+
+	config_read_lock();
+	_log = __atomic_load_n(&log->_log, __ATOMIC_ACQUIRE);
+	int level = calculate_threshold(log);
+	if (_log) {
+		// Flight recorder records all messages
+		bool recorder = log_config(log)->recorder != NULL;
+		threshold = pack_threshold(generation, recorder ? LL_TRACE : level, recorder);
+		__atomic_store_n(&_log->output_threshold, level, __ATOMIC_RELAXED);
+		__atomic_store_n(&_log->threshold.value, threshold, __ATOMIC_RELEASE);
+	} else {
+		threshold = pack_threshold(generation, level, false);
+		__atomic_store_n(&_logc_default_threshold.value, threshold, __ATOMIC_RELEASE);
+	}
+	config_read_unlock();
+	return threshold;
+}
+
+int log_threshold(log_t log) {
+	return (int)(cached_threshold(log) & _LOGC_THRESHOLD_LEVEL) + LL_TRACE;
+}
+
+int log_output_threshold(log_t log) {
+	unsigned threshold = cached_threshold(log);
+	if (threshold & _LOGC_THRESHOLD_RECORDER)
+		return __atomic_load_n(&log->_log->output_threshold, __ATOMIC_RELAXED);
+	return (int)(threshold & _LOGC_THRESHOLD_LEVEL) + LL_TRACE;
+}
+
+bool log_has_recorder(log_t log) {
+	return cached_threshold(log) & _LOGC_THRESHOLD_RECORDER;
+}
+
 int log_level(log_t log) {
-	if (log->_log == NULL)
-		return DEF_LEVEL;
-	return log->_log->level;
+	config_read_lock();
+	int res = log_config(log)->level;
+	config_read_unlock();
+	return res;
 }
 
 void log_set_level(log_t log, int level) {
-	log_allocate(log);
-	log->_log->level = level;
+	struct log_config *config = config_edit(log);
+	config->level = level;
+	config_commit(log, config);
 }
 
 void log_verbose(log_t log) {
-	log_allocate(log);
-	log->_log->level--;
+	struct log_config *config = config_edit(log);
+	config->level--;
+	config_commit(log, config);
 }
 
 void log_quiet(log_t log) {
-	log_allocate(log);
-	log->_log->level++;
+	struct log_config *config = config_edit(log);
+	config->level++;
+	config_commit(log, config);
 }
 
 void log_offset_level(log_t log, int offset) {
-	log_allocate(log);
-	log->_log->level += offset;
+	struct log_config *config = config_edit(log);
+	config->level += offset;
+	config_commit(log, config);
 }
@@ -5,7 +5,29 @@
 #include "log.h"
 #include <logc.h>
 
-bool verbose_filter(enum log_message_level, log_t, const struct output *out)
-	__attribute__((nonnull(2)));
+// Check if message of given level should be outputted. The level is relative to
+// the top level log that has provided configuration.
+bool verbose_filter(enum log_message_level, const struct log_config *,
+		const struct output *out) __attribute__((nonnull(2)));
+
+// Generation of logs configuration (_logc_generation declared in logc.h). It has
+// to be incremented on every change that can affect verbosity of any log to
+// invalidate cached thresholds. Global counter is used because there are no links
+// from dominant logs to the bound ones.
+static inline void log_config_changed() {
+	__atomic_add_fetch(&_logc_generation, 1, __ATOMIC_RELEASE);
+}
+
+// Minimal message level that would be outputted by given log trough any of its
+// outputs (including syslog) or recorded by its flight recorder. This covers the
+// whole chain of bound logs.
+// The value is cached in log and recalculated only when generation changes.
+int log_threshold(log_t) __attribute__((nonnull));
+
+// The same as log_threshold but ignoring the flight recorder
+int log_output_threshold(log_t) __attribute__((nonnull));
+
+// If log has flight recorder. This is cached together with threshold.
+bool log_has_recorder(log_t) __attribute__((nonnull));
 
 #endif
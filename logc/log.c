@@ -12,285 +12,655 @@
 #include "format.h"
 #include "output.h"
 #include "level.h"
+#include "callsite.h"
+#include "config.h"
+#include "record.h"
+#include "deferred.h"
+#include "timestamp.h"
+#include "dedup.h"
+#include "ratelimit.h"
+#include "sampling.h"
+#include "recorder.h"
 #include "util.h"
 
 // Set we use to mask all signals when we output logs
 sigset_t sigfullset;
 
+static enum log_signal_safety signal_safety = LOG_SIG_DEFER;
+
 
 __attribute__((constructor))
 static void constructor() {
 	sigfillset(&sigfullset);
 }
 
-const struct _log _log_default = {
-	.level = DEF_LEVEL,
-	.dominator = NULL,
-	.outs = NULL,
-	.outs_cnt = 0,
-	.syslog_format = NULL,
-	.no_stderr = DEF_NO_STDERR,
-	.no_syslog = DEF_NO_SYSLOG,
-	.use_origin = DEF_USE_ORIGIN,
-};
-
 static inline enum log_message_level message_level_sanity(int l) {
 	return l > LL_CRITICAL ? LL_CRITICAL : l < LL_TRACE ? LL_TRACE : l;
 }
 
-void log_allocate(log_t log) {
-	if (log->_log)
-		return;
-	log->_log = malloc(sizeof *log->_log);
-	*log->_log = _log_default;
-}
-
 void log_free(log_t log) {
-	if (!log->_log)
+	struct log_config *config = config_remove(log);
+	if (config == NULL)
 		return;
-	free_format(log->_log->syslog_format);
-	log_wipe_outputs(log);
-	free(log->_log);
-	log->_log = NULL;
-}
-
-bool log_would_log(log_t log, enum log_message_level msg_level) {
-	if (log->_log) {
-		if (log->_log->dominator)
-			return log_would_log(log->_log->dominator, msg_level + log->_log->level);
-		if (log->_log->outs) {
-			for (size_t i = 0; i < log->_log->outs_cnt; i++)
-				if (verbose_filter(msg_level, log, &log->_log->outs[i]))
-					return true;
-			return false;
-		}
-	}
-	return verbose_filter(msg_level, log, NULL);
-}
-
-static const struct format *if_seek_forward(const struct format *format,
-		enum log_message_level level, bool is_term, bool colors, bool use_origin,
-		bool no_log_name, bool no_msg, bool no_err) {
-	bool is_not_empty_check = true;
-	bool skip = false;
-	switch (format->condition) {
-		case FIFC_NON_EMPTY:
-			is_not_empty_check = false;
-			break;
-		case FIFC_LEVEL:
-			skip = level < format->if_level;
-			break;
-		case FIFC_TERMINAL:
-			skip = !is_term;
-			break;
-		case FIFC_COLORED:
-			skip = !colors;
-			break;
-	}
-
-	if (is_not_empty_check) {
-		if (skip == format->if_invert)
-			return format;
-
-		size_t depth = 0;
-		while (format) {
-			switch (format->type) {
-				case FF_IF:
-					depth++;
-					break;
-				case FF_ELSE:
-					if (depth > 1)
-						break;
-				case FF_IFEND:
-					depth--;
-					if (depth == 0)
-						return format;
-				default: // ignore anything else
-					break;
-			}
-			format = format->next;
-		};
-		return NULL;
-	}
-
-	for (const struct format *f = format->next; f; f = f->next) {
-		bool empty = true;
-		switch (f->type) {
-			case FF_TEXT:
-				// We ignore text as that is part of format and not expanded field
-				break;
-			case FF_MESSAGE:
-				empty = no_msg;
-				break;
-			case FF_NAME:
-				empty = no_log_name;
-				break;
-			case FF_SOURCE_FILE:
-			case FF_SOURCE_LINE:
-			case FF_SOURCE_FUNC:
-				empty = !use_origin;
-				break;
-			case FF_STD_ERR:
-				empty = no_err;
-				break;
-			case FF_IF:
-				// Use recurse to skip to FF_IFEND if condition is not satisfied
-				f = if_seek_forward(f, level, is_term, colors, use_origin, no_log_name, no_msg, no_err);
-				// This condition is empty if we skipped it. Otherwise it is not.
-				empty = f->type == FF_IFEND;
-				break;
-			case FF_ELSE:
-			case FF_IFEND:
-				return f;
-		}
-		if (!empty)
-			return format;
+	format_set_free(config->syslog_format);
+	free(config->syslog_format);
+	recorder_free(config->recorder);
+	for (size_t i = 0; i < config->outs_cnt; i++) {
+		free_output(config->outs[i], true);
+		free(config->outs[i]);
 	}
-	return NULL;
+	config_free(config);
 }
 
-static const struct format *else_seek_forward(const struct format *format) {
-	size_t depth = 1;
-	for (; format; format = format->next) {
-		switch (format->type) {
-			case FF_IF:
-				depth++;
-				break;
-			case FF_IFEND:
-				depth--;
-				if (depth == 0)
-					return format;
-				break;
-			default:
-				// Ignore the rest
-				break;
-		}
-	}
-	return NULL;
+bool log_would_log(log_t log, enum log_message_level msg_level) {
+	return message_level_sanity(msg_level) >= log_threshold(log);
 }
 
-static void do_log(const struct output *out, enum log_message_level msg_level,
-		const char *log_name, const char *file, size_t line, const char *func,
-		bool use_origin, bool msg_empty, int stderrno,
-		const char *msgformat, va_list args) {
-	const struct format *format = out->format;
-	do {
-		switch (format->type) {
+void render_line(struct record *r, const struct output *out,
+		enum log_message_level msg_level, const char *log_name, const char *file,
+		size_t line, const char *func, const char *origin, bool use_origin,
+		unsigned present, const char *err, struct log_time *time,
+		unsigned sample_rate, const char *msg, size_t msg_len) {
+	const struct format *format = format_set_get(&out->format, msg_level);
+	const struct timespec *last_time = NULL;
+	for (size_t i = 0; i < format->cnt; i++) {
+		const struct format_op *op = &format->ops[i];
+		switch (op->type) {
 			case FF_TEXT:
-				fputs(format->text, out->f);
+				record_append(r, op->text, op->len);
 				break;
 			case FF_MESSAGE:
-				vfprintf(out->f, msgformat, args);
+				record_append(r, msg, msg_len);
 				break;
 			case FF_NAME:
 				if (log_name)
-					fputs(log_name, out->f);
+					record_puts(r, log_name);
 				break;
 			case FF_SOURCE_FILE:
 				if (use_origin)
-					fputs(file, out->f);
+					record_puts(r, file);
 				break;
 			case FF_SOURCE_LINE:
 				if (use_origin)
-					fprintf(out->f, "%zu", line);
+					record_printf(r, "%zu", line);
 				break;
 			case FF_SOURCE_FUNC:
 				if (use_origin)
-					fputs(func, out->f);
+					record_puts(r, func);
+				break;
+			case FF_ORIGIN:
+				// Same output as separate fields and text it replaces
+				if (!use_origin)
+					record_append(r, "(:,)", 4);
+				else if (origin)
+					record_puts(r, origin);
+				else
+					record_printf(r, "(%s:%zu,%s)", file, line, func);
 				break;
 			case FF_STD_ERR:
-				if (stderrno)
-					fputs(strerror(stderrno), out->f);
+				if (err)
+					record_puts(r, err);
+				break;
+			case FF_TIME_ISO:
+			case FF_TIME_UTC:
+			case FF_TIME_ZONE:
+			case FF_TIME_RFC3339:
+			case FF_TIME_EPOCH:
+			case FF_TIME_MONO:
+			case FF_TIME_ELAPSED:
+			case FF_TIME_FRAC:
+				render_time(r, op, time, &last_time);
+				break;
+			case FF_SAMPLE_RATE:
+				if (sample_rate > 1)
+					record_printf(r, "%u", sample_rate);
 				break;
 			case FF_IF:
-				format = if_seek_forward(format, msg_level, out->is_terminal,
-						out->use_colors, use_origin, str_empty(log_name),
-						msg_empty, stderrno == 0);
+				if (!format_condition(format, i, msg_level, out->is_terminal,
+							out->use_colors, present))
+					i = op->jump - 1;
 				break;
 			case FF_ELSE:
-				// Just skip else block as it is termination of valid
-				// condition.
-				format = else_seek_forward(format);
+				// End of fulfilled condition so skip else block
+				i = op->jump - 1;
 				break;
 			case FF_IFEND:
-				// Everything already done in FF_IF
+				// Not present in compiled format
 				break;
 		}
-		format = format->next;
-	} while (format);
-	fputc('\n', out->f);
-	fflush(out->f);
+	}
+	record_append(r, "\n", 1);
 }
 
-void _logc(log_t log, enum log_message_level msg_level,
-		const char *file, size_t line, const char *func,
-		const char *msgformat, ...) {
-	int stderrno = errno;
-	int level = msg_level = message_level_sanity(msg_level);
-	const char *name = log->name;
+// Messages are rendered to the buffer on stack and only longer ones are rendered
+// to the thread local buffer. That one is kept allocated for subsequent messages.
+#define MSG_STACK_SIZE 256
+static __thread char *msg_buf = NULL;
+static __thread size_t msg_buf_size = 0;
+static __thread bool msg_buf_used = false;
 
-	// Traverse to top level dominator
-	while (log->_log && log->_log->dominator) {
-		level -= log->_log->level;
-		log = log->_log->dominator;
+// Render message to stack buffer (of MSG_STACK_SIZE) or thread local buffer.
+// The allocated is set to true if returned buffer has to be freed. That happens
+// only if thread local buffer is already in use (signal handler).
+static char *render_message(char *stack_buf, size_t *len, bool *allocated,
+		const char *msgformat, va_list args) {
+	*allocated = false;
+	va_list cargs;
+	va_copy(cargs, args);
+	int res = vsnprintf(stack_buf, MSG_STACK_SIZE, msgformat, cargs);
+	va_end(cargs);
+	if (res < 0) {
+		*len = 0;
+		return stack_buf;
 	}
+	*len = res;
+	if (*len < MSG_STACK_SIZE)
+		return stack_buf;
 
-	// This works with expectation that although there can be as many error as
-	// trace messages in the code the trace messages are likely called while error
-	// message unlikely. In other words the likeliness of log being called
-	// decreases with message level. At the same time the most likely execution is
-	// without debug output so it should be in most cases more optimal to check if
-	// it makes even sense to continue.
-	// TODO we could calculate common level when we set verbosity and just compare
-	if (level < LL_INFO && !log_would_log(log, level))
+	char *buf;
+	if (msg_buf_used) {
+		buf = malloc(*len + 1);
+		*allocated = true;
+	} else {
+		// Mark as used first so signal handler won't use it while we reallocate it
+		msg_buf_used = true;
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		if (msg_buf_size <= *len) {
+			free(msg_buf);
+			msg_buf_size = *len + 1;
+			msg_buf = malloc(msg_buf_size);
+		}
+		buf = msg_buf;
+	}
+	va_copy(cargs, args);
+	vsnprintf(buf, *len + 1, msgformat, cargs);
+	va_end(cargs);
+	return buf;
+}
+
+static void release_message(char *buf, bool allocated) {
+	if (allocated)
+		free(buf);
+	else if (buf == msg_buf)
+		msg_buf_used = false;
+}
+
+// Message is rendered only if there is output that needs it. Outputs with
+// deferred formatting receive only captured arguments.
+struct message {
+	const char *format; // NULL if message is already rendered
+	va_list *args;
+	char *stack_buf; // MSG_STACK_SIZE buffer for render_message
+	int stderrno; // errno for %m in format
+	char *text;
+	size_t len;
+	bool allocated;
+	unsigned sample_rate; // one if message is not sampled
+};
+
+static void message_render(struct message *msg) {
+	if (msg->text)
 		return;
+	errno = msg->stderrno;
+	msg->text = render_message(msg->stack_buf, &msg->len, &msg->allocated,
+			msg->format, *msg->args);
+}
 
-	size_t cnt = 1;
-	const struct output *outs = default_stderr_output();
-	if (log->_log) {
-		if (log->_log->outs_cnt) {
-			cnt = log->_log->outs_cnt;
-			outs = log->_log->outs;
-		} else if (log->_log->no_stderr)
-			cnt = 0;
+static void message_release(struct message *msg) {
+	if (msg->text)
+		release_message(msg->text, msg->allocated);
+}
+
+// Output message
+static void emit(log_t log, enum log_message_level msg_level, bool forced,
+		int stderrno, struct log_callsite *cs, const char *file, size_t line,
+		const char *func, struct message *msg) {
+	int level = msg_level;
+	const char *name = log->name;
+
+	config_read_lock();
+	// Traverse to top level dominator
+	const struct log_config *config = log_config(log);
+	while (config->dominator) {
+		level -= config->level;
+		log = config->dominator;
+		config = log_config(log);
 	}
-	bool use_origin = log_use_origin(log);
 
-	va_list args;
-	va_start(args, msgformat);
-	bool msg_empty = vsnprintf(NULL, 0, msgformat, args) == 0;
-	va_end(args);
+	size_t cnt = 1;
+	const struct output *stderr_output = default_stderr_output();
+	struct output *const *outs = (struct output *const *)&stderr_output;
+	if (config->outs_cnt) {
+		cnt = config->outs_cnt;
+		outs = config->outs;
+	} else if (config->no_stderr)
+		cnt = 0;
+	bool use_origin = log_use_origin(log);
+	const char *origin = use_origin && cs ? callsite_origin(cs) : NULL;
+	bool rendered = false;
+	const char *err = NULL;
+	// Time is shared by all outputs and clocks are read once first needed
+	struct log_time time = {0};
+	unsigned long hash = 0; // for outputs with deduplication
+	// Fields that are considered non-empty by format conditions (FM_MESSAGE is
+	// added once message is rendered)
+	unsigned present = (str_empty(name) ? 0 : FM_NAME) |
+		(use_origin ? FM_ORIGIN : 0) |
+		(stderrno ? FM_STD_ERR : 0) |
+		(msg->sample_rate > 1 ? FM_SAMPLED : 0);
 
+	bool mask = signal_safety == LOG_SIG_MASK;
+	bool mask_write = signal_safety == LOG_SIG_MASK_WRITE;
 	sigset_t sigorigset;
-	sigprocmask(SIG_BLOCK, &sigfullset, &sigorigset);
+	if (mask)
+		sigprocmask(SIG_BLOCK, &sigfullset, &sigorigset);
 
-#define DO_LOG(OUT) { \
-		va_start(args, msgformat); \
-		do_log(&OUT, msg_level, name, file, line, func, use_origin, msg_empty, stderrno, msgformat, args); \
-		va_end(args); \
-	}
+#define DO_LOG(OUT) \
+		render_line(&record, OUT, msg_level, name, file, line, func, origin, \
+				use_origin, present, err, &time, msg->sample_rate, msg->text, msg->len)
+#define RENDER_MSG do { \
+			if (!rendered) { \
+				message_render(msg); \
+				present |= msg->len ? FM_MESSAGE : 0; \
+				err = stderrno ? strerror(stderrno) : NULL; \
+				rendered = true; \
+			} \
+		} while (false)
 
+	struct record record;
+	record_init(&record);
+	// Arguments are captured only once for all outputs with deferred formatting
+	struct record captured;
+	record_init(&captured);
+	enum { CAPTURE_NONE, CAPTURE_DONE, CAPTURE_FAILED } capture =
+		msg->format ? CAPTURE_NONE : CAPTURE_FAILED;
 	for (size_t i = 0; i < cnt; i++) {
-		if (!verbose_filter(level, log, &outs[i]))
+		if (!forced && !verbose_filter(level, config, outs[i]))
+			continue;
+		if (outs[i]->binary) {
+			struct binary_message bmsg = {
+				.level = msg_level,
+				.name = str_empty(name) ? NULL : name,
+				.file = file,
+				.line = line,
+				.func = func,
+				.use_origin = use_origin,
+				.stderrno = stderrno,
+				.format = msg->format,
+				.args = msg->args,
+				.time = &time,
+				.sample_rate = msg->sample_rate,
+			};
+			if (mask_write)
+				sigprocmask(SIG_BLOCK, &sigfullset, &sigorigset);
+			if (!msg->format || !binary_emit(outs[i], &bmsg)) {
+				RENDER_MSG;
+				bmsg.format = NULL;
+				bmsg.text = msg->text;
+				bmsg.len = msg->len;
+				binary_emit(outs[i], &bmsg);
+			}
+			if (mask_write)
+				sigprocmask(SIG_SETMASK, &sigorigset, NULL);
 			continue;
-		lock_output(&outs[i]);
+		}
+		if (outs[i]->dedup) {
+			RENDER_MSG;
+			if (!hash)
+				hash = dedup_hash(msg_level, name, msg->text, msg->len, err);
+			struct dedup_summary summary;
+			if (!dedup_record(outs[i]->dedup, hash, msg_level, name, &summary))
+				continue;
+			if (summary.repeated) {
+				record.len = 0;
+				dedup_render(&record, outs[i], &summary, &time);
+				if (mask_write)
+					sigprocmask(SIG_BLOCK, &sigfullset, &sigorigset);
+				output_emit(outs[i], record.data, record.len, false);
+				if (mask_write)
+					sigprocmask(SIG_SETMASK, &sigorigset, NULL);
+			}
+		}
+		if (outs[i]->deferred && outs[i]->async && capture != CAPTURE_FAILED) {
+			if (capture == CAPTURE_NONE) {
+				struct deferred header = {
+					.level = msg_level,
+					.present = present,
+					.stderrno = stderrno,
+					.use_origin = use_origin,
+					.file = file,
+					.line = line,
+					.func = func,
+					.origin = origin,
+					.sample_rate = msg->sample_rate,
+				};
+				// Clocks are read now as message is rendered later
+				if (outs[i]->format.clocks)
+					log_time_read(&time, LT_REAL | LT_MONO);
+				header.time = time;
+				header.time.frozen = true;
+				va_list args;
+				va_copy(args, *msg->args);
+				capture = deferred_capture(&captured, &header, name ?: "",
+						msg->format, args) ? CAPTURE_DONE : CAPTURE_FAILED;
+				va_end(args);
+			}
+			if (capture == CAPTURE_DONE) {
+				if (mask_write)
+					sigprocmask(SIG_BLOCK, &sigfullset, &sigorigset);
+				bool queued = async_write_deferred(outs[i]->async, captured.data,
+						captured.len);
+				if (mask_write)
+					sigprocmask(SIG_SETMASK, &sigorigset, NULL);
+				if (queued)
+					continue;
+			}
+		}
+		RENDER_MSG;
+		record.len = 0;
 		DO_LOG(outs[i]);
-		unlock_output(&outs[i]);
+		if (mask_write)
+			sigprocmask(SIG_BLOCK, &sigfullset, &sigorigset);
+		output_emit(outs[i], record.data, record.len, msg_level >= LL_ERROR);
+		if (mask_write)
+			sigprocmask(SIG_SETMASK, &sigorigset, NULL);
 	}
 
-	if (log_syslog(log) && verbose_filter(level, log, NULL)) {
+	if (config_syslog(log, config) && (forced || verbose_filter(level, config, NULL))) {
 		struct output out;
-		char *str;
-		size_t str_len;
-		syslog_output(&out, &str, &str_len,
-				log->_log ? log->_log->syslog_format : NULL);
-		DO_LOG(out);
-		fclose(out.f);
-		syslog(msg2syslog_level(msg_level), "%s", str);
-		free(str);
+		syslog_output(&out, config->syslog_format);
+		RENDER_MSG;
+		record.len = 0;
+		DO_LOG(&out);
+		if (mask_write)
+			sigprocmask(SIG_BLOCK, &sigfullset, &sigorigset);
+		syslog(msg2syslog_level(msg_level), "%.*s", (int)record.len, record.data);
+		if (mask_write)
+			sigprocmask(SIG_SETMASK, &sigorigset, NULL);
+	}
+
+	if (mask)
+		sigprocmask(SIG_SETMASK, &sigorigset, NULL);
+	config_read_unlock();
+	record_free(&record);
+	record_free(&captured);
+}
+
+// Messages from signal handlers that interrupted logging are stored to the
+// pending queue. It is drained by interrupted code before it leaves _logc.
+#define PENDING_SIZE 4
+#define PENDING_MSG_SIZE 256
+struct pending {
+	log_t log;
+	enum log_message_level level;
+	bool forced;
+	int stderrno;
+	struct log_callsite *cs;
+	const char *file;
+	size_t line;
+	const char *func;
+	unsigned sample_rate;
+	bool dump; // dump flight recorder of log instead of outputting message
+	size_t msg_len;
+	char msg[PENDING_MSG_SIZE];
+};
+static __thread struct pending pending[PENDING_SIZE];
+static __thread unsigned pending_cnt = 0;
+static __thread volatile sig_atomic_t in_logc = false;
+
+// Message is rendered to fixed size buffer as we can't use thread local buffer
+// nor allocate memory in signal handler.
+static void pending_render(struct pending *p, log_t log,
+		enum log_message_level msg_level, bool forced, int stderrno,
+		struct log_callsite *cs, const char *file, size_t line, const char *func,
+		const struct message *msg) {
+	*p = (struct pending){
+		.log = log,
+		.level = msg_level,
+		.forced = forced,
+		.stderrno = stderrno,
+		.cs = cs,
+		.file = file,
+		.line = line,
+		.func = func,
+		.sample_rate = msg->sample_rate,
+	};
+	va_list args;
+	va_copy(args, *msg->args);
+	errno = stderrno;
+	int res = vsnprintf(p->msg, PENDING_MSG_SIZE, msg->format, args);
+	va_end(args);
+	p->msg_len = res < 0 ? 0 : res < PENDING_MSG_SIZE ? res : PENDING_MSG_SIZE - 1;
+}
+
+static void defer(const struct pending *p) {
+	// Signal handler can be interrupted by other signal handler and thus we
+	// reserve slot atomically.
+	unsigned i = __atomic_fetch_add(&pending_cnt, 1, __ATOMIC_RELAXED);
+	if (i >= PENDING_SIZE)
+		return; // Queue is full so message is dropped
+	pending[i] = *p;
+	__atomic_signal_fence(__ATOMIC_RELEASE);
+}
+
+// Critical message is commonly followed by program termination and thus it can't
+// wait only in the queue. It is also written directly to the standard error as
+// that does not require any lock.
+static void write_critical(const struct pending *p) {
+	char buf[PENDING_MSG_SIZE + 64];
+	int len = snprintf(buf, sizeof buf, "CRITICAL:%s%s%.*s\n", p->log->name ?: "",
+			str_empty(p->log->name) ? "" : ": ", (int)p->msg_len, p->msg);
+	if (len < 0)
+		return;
+	if ((size_t)len >= sizeof buf) {
+		len = sizeof buf - 1;
+		buf[len - 1] = '\n';
 	}
+	while (write(STDERR_FILENO, buf, len) == -1 && errno == EINTR);
+}
 
-	sigprocmask(SIG_SETMASK, &sigorigset, NULL);
+static void drain_pending() {
+	unsigned done = 0;
+	while (true) {
+		unsigned cnt = __atomic_load_n(&pending_cnt, __ATOMIC_RELAXED);
+		__atomic_signal_fence(__ATOMIC_ACQUIRE);
+		if (done >= cnt) {
+			// Reset only if there was no new message added in the meantime
+			if (__atomic_compare_exchange_n(&pending_cnt, &cnt, 0, false,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				return;
+			continue;
+		}
+		if (done < PENDING_SIZE && pending[done].dump)
+			log_recorder_dump(pending[done].log);
+		else if (done < PENDING_SIZE) {
+			struct pending *p = &pending[done];
+			struct message msg = {
+				.text = p->msg,
+				.len = p->msg_len,
+				.sample_rate = p->sample_rate,
+			};
+			emit(p->log, p->level, p->forced, p->stderrno, p->cs, p->file,
+					p->line, p->func, &msg);
+		}
+		done++;
+	}
+}
+
+// Record message to flight recorder of log. Recorded messages are dumped on
+// critical message. Returns false if log has no flight recorder. Signal handler
+// that interrupted logging records without allocation and its dump is deferred.
+static bool record(log_t log, enum log_message_level msg_level, int stderrno,
+		struct log_callsite *cs, const char *file, size_t line, const char *func,
+		const char *format, va_list args, bool interrupted) {
+	config_read_lock();
+	const struct log_config *config = log_config(log);
+	struct recorder *rec = config->recorder;
+	if (rec) {
+		bool use_origin = log_use_origin(log);
+		struct deferred header = {
+			.level = msg_level,
+			.present = (str_empty(log->name) ? 0 : FM_NAME) |
+				(use_origin ? FM_ORIGIN : 0) |
+				(stderrno ? FM_STD_ERR : 0),
+			.stderrno = stderrno,
+			.use_origin = use_origin,
+			.file = file,
+			.line = line,
+			.func = func,
+			.sample_rate = 1,
+		};
+		// Origin is not rendered in signal handler (it is allocated)
+		if (use_origin && cs)
+			header.origin = interrupted ?
+				__atomic_load_n(&cs->origin, __ATOMIC_ACQUIRE) : callsite_origin(cs);
+		// Clocks are read now as message is rendered later
+		log_time_read(&header.time, LT_REAL | LT_MONO);
+		header.time.frozen = true;
+		recorder_record(rec, &header, log->name ?: "", format, args, interrupted);
+		if (msg_level == LL_CRITICAL && interrupted)
+			defer(&(struct pending){.log = log, .dump = true});
+		else if (msg_level == LL_CRITICAL)
+			recorder_dump(log, config, false);
+	}
+	config_read_unlock();
+	return rec != NULL;
+}
 
+// Record and output message that passed threshold. Signal handler that
+// interrupted logging in this thread can't take any lock it might hold and thus
+// message is only deferred in such case.
+static void handle_message(log_t log, enum log_message_level msg_level,
+		bool forced, int stderrno, struct log_callsite *cs, const char *file,
+		size_t line, const char *func, const char *msgformat, va_list args,
+		bool interrupted) {
+	// Messages below verbosity get this far only if log has flight recorder. The
+	// configuration is read only if cached threshold says there is one.
+	if (log_has_recorder(log) &&
+			record(log, msg_level, stderrno, cs, file, line, func, msgformat, args,
+				interrupted) &&
+			!forced && msg_level < log_output_threshold(log))
+		return;
+
+	// Sampling is decided before message is formatted
+	unsigned sample_rate = 1;
+	if (cs && cs->sampling &&
+			!(sample_rate = sampling_pass(cs->sampling, &cs->sampling->_count)))
+		return;
+	if (!forced) {
+		config_read_lock();
+		const struct log_config *config = log_config(log);
+		unsigned rate = 1;
+		if (config->sampling.mode != LOG_SAMPLE_ALL && msg_level <= config->sampling_level)
+			rate = sampling_pass(&config->sampling, &log->_log->sample_count);
+		config_read_unlock();
+		if (!rate)
+			return;
+		sample_rate *= rate;
+	}
+
+	char stack_buf[MSG_STACK_SIZE];
+	va_list margs;
+	va_copy(margs, args);
+	struct message message = {
+		.format = msgformat,
+		.args = &margs,
+		.stack_buf = stack_buf,
+		.stderrno = stderrno,
+		.sample_rate = sample_rate,
+	};
+	struct message *msg = &message;
+
+	if (interrupted) {
+		struct pending p;
+		pending_render(&p, log, msg_level, forced, stderrno, cs, file, line,
+				func, msg);
+		if (msg_level == LL_CRITICAL)
+			write_critical(&p);
+		defer(&p);
+	} else
+		emit(log, msg_level, forced, stderrno, cs, file, line, func, msg);
+
+	message_release(msg);
+	va_end(margs);
+}
+
+static void vlogc(log_t log, enum log_message_level msg_level, int stderrno,
+		struct log_callsite *cs, const char *file, size_t line, const char *func,
+		const char *msgformat, va_list args) {
+	msg_level = message_level_sanity(msg_level);
+	// Messages enabled trough callsite are not subject of verbosity
+	bool forced = cs && cs->flags & LOG_CS_ENABLED;
+
+	// The most likely execution is without debug output so it is beneficial to
+	// check if it makes even sense to continue. The threshold is cached in log
+	// and thus this is in most cases just a single compare.
+	if (!forced && msg_level < log_threshold(log))
+		return;
+
+	if (signal_safety != LOG_SIG_DEFER) {
+		handle_message(log, msg_level, forced, stderrno, cs, file, line, func,
+				msgformat, args, false);
+	} else if (in_logc) {
+		// We interrupted logging in this thread
+		handle_message(log, msg_level, forced, stderrno, cs, file, line, func,
+				msgformat, args, true);
+	} else {
+		in_logc = true;
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		handle_message(log, msg_level, forced, stderrno, cs, file, line, func,
+				msgformat, args, false);
+		while (true) {
+			drain_pending();
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+			in_logc = false;
+			__atomic_signal_fence(__ATOMIC_SEQ_CST);
+			// Message could have been deferred right before we cleared flag
+			if (!__atomic_load_n(&pending_cnt, __ATOMIC_RELAXED))
+				break;
+			in_logc = true;
+		}
+	}
 	errno = 0; // always end with errno zero
 }
+
+enum log_signal_safety log_signal_safety() {
+	return signal_safety;
+}
+
+void log_set_signal_safety(enum log_signal_safety safety) {
+	signal_safety = safety;
+}
+
+void _logc(log_t log, enum log_message_level msg_level,
+		const char *file, size_t line, const char *func,
+		const char *msgformat, ...) {
+	int stderrno = errno;
+	va_list args;
+	va_start(args, msgformat);
+	vlogc(log, msg_level, stderrno, NULL, file, line, func, msgformat, args);
+	va_end(args);
+}
+
+static void logc_callsite(struct log_callsite *cs, log_t log,
+		enum log_message_level msg_level, const char *msgformat, ...) {
+	va_list args;
+	va_start(args, msgformat);
+	vlogc(log, msg_level, 0, cs, cs->file, cs->line, cs->func, msgformat, args);
+	va_end(args);
+}
+
+void _logc_callsite(struct log_callsite *cs, log_t log,
+		enum log_message_level msg_level, const char *msgformat, ...) {
+	int stderrno = errno;
+	size_t suppressed = 0;
+	if (cs->ratelimit && !ratelimit_pass(cs->ratelimit, &suppressed))
+		return;
+	if (suppressed)
+		logc_callsite(cs, log, msg_level, "Suppressed %zu similar messages", suppressed);
+	va_list args;
+	va_start(args, msgformat);
+	vlogc(log, msg_level, stderrno, cs, cs->file, cs->line, cs->func,
+			msgformat, args);
+	va_end(args);
+}
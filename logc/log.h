@@ -8,23 +8,46 @@
 #include "output.h"
 #include "format.h"
 
-struct _log {
+// Configuration of log. It is never modified once published. Every change
+// creates a modified copy that replaces it (see config.h).
+struct log_config {
 	int level;
 	struct log *dominator;
-	struct output *outs;
+	struct output **outs;
 	size_t outs_cnt;
-	struct format *syslog_format;
+	struct format_set *syslog_format;
 	bool no_stderr;
 	bool no_syslog;
 	bool use_origin;
+	int sampling_level; // messages up to this level are sampled
+	struct log_sampling sampling;
+	struct recorder *recorder; // flight recorder (log_set_recorder)
+};
+
+struct _log {
+	// Cached verbosity threshold (see cached_threshold in level.c) valid only if
+	// its generation matches _logc_generation. This has to be the first field as it
+	// is accessed from inline code in logc.h.
+	struct _log_threshold threshold;
+
+	struct log_config *config;
+	int output_threshold; // threshold without flight recorder cached with threshold
+	size_t sample_count; // counter for sampling of log (see log_set_sampling)
 };
 
+struct record;
+struct log_time;
+
+// Render log line for given output to the record
+void render_line(struct record *r, const struct output *out,
+		enum log_message_level msg_level, const char *log_name, const char *file,
+		size_t line, const char *func, const char *origin, bool use_origin,
+		unsigned present, const char *err, struct log_time *time,
+		unsigned sample_rate, const char *msg, size_t msg_len);
+
 #define DEF_LEVEL 0
 #define DEF_NO_STDERR false
 #define DEF_NO_SYSLOG false
 #define DEF_USE_ORIGIN false
-extern const struct _log _log_default;
-
-void log_allocate(log_t log);
 
 #endif
@@ -0,0 +1,208 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "mapfile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define OPEN_FLAGS (O_RDWR | O_CREAT | O_CLOEXEC)
+#define OPEN_MODE 0666
+
+#define DEFAULT_REGION (1024 * 1024)
+#define DEFAULT_MAX_SIZE ((size_t)1024 * 1024 * 1024)
+
+// State shared by all processes using the mapping
+struct shared {
+	size_t tail; // offset where the next line is placed
+	size_t allocated; // allocated size of file
+	size_t full; // offset of the first line that did not fit (SIZE_MAX if none)
+	size_t dropped;
+	unsigned users; // number of processes using the mapping
+	time_t synced; // time of the last periodic msync
+};
+
+struct mapfile {
+	int fd;
+	char *map;
+	size_t size; // size of the mapping and thus maximal size of the file
+	size_t region;
+	unsigned sync_interval;
+	struct shared *shared;
+	struct mapfile *next, **prev;
+};
+
+// Mapping is inherited by forked process so it is registered as another user
+static struct mapfile *mapfiles = NULL;
+static pthread_mutex_t mapfiles_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void atfork_prepare() {
+	pthread_mutex_lock(&mapfiles_mutex);
+}
+
+static void atfork_parent() {
+	pthread_mutex_unlock(&mapfiles_mutex);
+}
+
+static void atfork_child() {
+	for (struct mapfile *m = mapfiles; m; m = m->next)
+		__atomic_add_fetch(&m->shared->users, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&mapfiles_mutex);
+}
+
+__attribute__((constructor))
+static void constructor() {
+	pthread_atfork(atfork_prepare, atfork_parent, atfork_child);
+}
+
+
+static time_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	return ts.tv_sec;
+}
+
+struct mapfile *mapfile_new(const char *path, const struct log_mmap *config,
+		bool trim) {
+	int fd = open(path, OPEN_FLAGS, OPEN_MODE);
+	if (fd == -1)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st)) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	struct mapfile *m = malloc(sizeof *m);
+	*m = (struct mapfile){
+		.fd = fd,
+		.size = (config && config->max_size) ? config->max_size : DEFAULT_MAX_SIZE,
+		.region = (config && config->region) ? config->region : DEFAULT_REGION,
+		.sync_interval = config ? config->sync_interval : 0,
+	};
+	if (m->size < (size_t)st.st_size)
+		m->size = st.st_size; // Nothing fits but we still need existing content
+	m->map = mmap(NULL, m->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	m->shared = mmap(NULL, sizeof *m->shared, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (m->map == MAP_FAILED || m->shared == MAP_FAILED) {
+		int err = errno;
+		if (m->map != MAP_FAILED)
+			munmap(m->map, m->size);
+		if (m->shared != MAP_FAILED)
+			munmap(m->shared, sizeof *m->shared);
+		close(fd);
+		free(m);
+		errno = err;
+		return NULL;
+	}
+	size_t tail = st.st_size;
+	// Unclean exit leaves preallocated space filled with zeros at the end
+	while (trim && tail > 0 && m->map[tail - 1] == '\0')
+		tail--;
+	*m->shared = (struct shared){
+		.tail = tail,
+		.allocated = st.st_size,
+		.full = SIZE_MAX,
+		.users = 1,
+		.synced = now(),
+	};
+
+	pthread_mutex_lock(&mapfiles_mutex);
+	m->next = mapfiles;
+	m->prev = &mapfiles;
+	if (mapfiles)
+		mapfiles->prev = &m->next;
+	mapfiles = m;
+	pthread_mutex_unlock(&mapfiles_mutex);
+	return m;
+}
+
+// Size of file that contains all written lines
+static size_t true_size(const struct shared *s) {
+	size_t size = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+	size_t full = __atomic_load_n(&s->full, __ATOMIC_ACQUIRE);
+	return size < full ? size : full;
+}
+
+void mapfile_free(struct mapfile *m) {
+	if (m == NULL)
+		return;
+	pthread_mutex_lock(&mapfiles_mutex);
+	if (m->next)
+		m->next->prev = m->prev;
+	*m->prev = m->next;
+	pthread_mutex_unlock(&mapfiles_mutex);
+
+	if (__atomic_sub_fetch(&m->shared->users, 1, __ATOMIC_ACQ_REL) == 0) {
+		size_t size = true_size(m->shared);
+		msync(m->map, size, MS_SYNC);
+		if (ftruncate(m->fd, size))
+			errno = 0; // ignore failure
+	}
+	munmap(m->map, m->size);
+	munmap(m->shared, sizeof *m->shared);
+	free(m);
+}
+
+int mapfile_fd(const struct mapfile *m) {
+	return m->fd;
+}
+
+// Make sure that file is allocated up to given offset
+static bool allocate(struct mapfile *m, size_t end) {
+	size_t allocated = __atomic_load_n(&m->shared->allocated, __ATOMIC_ACQUIRE);
+	while (allocated < end) {
+		size_t new = (end + m->region - 1) / m->region * m->region;
+		if (new > m->size)
+			new = m->size;
+		// Multiple writers might allocate the same space but that is harmless
+		if (posix_fallocate(m->fd, allocated, new - allocated))
+			return false;
+		if (__atomic_compare_exchange_n(&m->shared->allocated, &allocated, new,
+					false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+			break;
+	}
+	return true;
+}
+
+static void drop(struct mapfile *m, size_t offset) {
+	__atomic_add_fetch(&m->shared->dropped, 1, __ATOMIC_RELAXED);
+	size_t full = __atomic_load_n(&m->shared->full, __ATOMIC_RELAXED);
+	while (offset < full && !__atomic_compare_exchange_n(&m->shared->full, &full,
+				offset, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void mapfile_write(struct mapfile *m, const char *data, size_t len) {
+	size_t offset = __atomic_fetch_add(&m->shared->tail, len, __ATOMIC_RELAXED);
+	if (offset + len > m->size || !allocate(m, offset + len)) {
+		drop(m, offset);
+		return;
+	}
+	memcpy(m->map + offset, data, len);
+
+	if (m->sync_interval) {
+		time_t time = now();
+		time_t synced = __atomic_load_n(&m->shared->synced, __ATOMIC_RELAXED);
+		if (time - synced >= m->sync_interval &&
+				__atomic_compare_exchange_n(&m->shared->synced, &synced, time,
+					false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			msync(m->map, __atomic_load_n(&m->shared->allocated, __ATOMIC_RELAXED),
+					MS_ASYNC);
+	}
+}
+
+void mapfile_sync(struct mapfile *m) {
+	msync(m->map, __atomic_load_n(&m->shared->allocated, __ATOMIC_ACQUIRE), MS_SYNC);
+}
+
+size_t mapfile_dropped(const struct mapfile *m) {
+	return __atomic_load_n(&m->shared->dropped, __ATOMIC_RELAXED);
+}
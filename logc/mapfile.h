@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_MAPFILE_H_
+#define _LOGC_MAPFILE_H_
+#include <logc.h>
+#include <stddef.h>
+
+// State of memory mapped file output (log_add_mmap_output). Lines are copied to
+// shared mapping of the file. Space for line is reserved by atomic addition to
+// the tail offset that is stored in shared memory so threads as well as forked
+// processes append to the same file without any lock.
+struct mapfile;
+
+// Open file on given path and map it. Trailing zero bytes left by unclean exit are
+// overwritten if trim is true (not suitable for binary content). Returns NULL and
+// sets errno on failure.
+struct mapfile *mapfile_new(const char *path, const struct log_mmap *config,
+		bool trim)
+	__attribute__((nonnull(1)));
+// Unmap file. The last process that frees it truncates file to its true length.
+// File descriptor is not closed.
+void mapfile_free(struct mapfile *m);
+
+// File descriptor of output
+int mapfile_fd(const struct mapfile *m) __attribute__((nonnull));
+
+// Append line to file
+void mapfile_write(struct mapfile *m, const char *data, size_t len)
+	__attribute__((nonnull));
+
+// Synchronize written lines to the file
+void mapfile_sync(struct mapfile *m) __attribute__((nonnull));
+
+// Number of lines dropped because there was no space left
+size_t mapfile_dropped(const struct mapfile *m) __attribute__((nonnull));
+
+#endif
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // Copyright 2020, CZ.NIC z.s.p.o. (http://www.nic.cz/)
 #include "log.h"
+#include "config.h"
 #include "util.h"
 
 #define ENV_LOG_ORIGIN "LOG_ORIGIN"
@@ -14,13 +15,16 @@ static bool log_origin_from_env() {
 }
 
 bool log_use_origin(log_t log) {
-	if (log->_log)
-		return log->_log->use_origin;
-	else
+	if (__atomic_load_n(&log->_log, __ATOMIC_ACQUIRE) == NULL)
 		return log_origin_from_env();
+	config_read_lock();
+	bool res = log_config(log)->use_origin;
+	config_read_unlock();
+	return res;
 }
 
 void log_set_use_origin(log_t log, bool use) {
-	log_allocate(log);
-	log->_log->use_origin = use;
+	struct log_config *config = config_edit(log);
+	config->use_origin = use;
+	config_commit(log, config);
 }
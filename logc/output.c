@@ -1,18 +1,51 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // Copyright 2020, CZ.NIC z.s.p.o. (http://www.nic.cz/)
 #include "output.h"
+#include "level.h"
+#include "config.h"
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+// Locking appropriate for given file descriptor
+static enum output_lock default_lock(int fd) {
+	if (fd == -1)
+		return OL_NONE; // Without file descriptor the FILE itself is locked
+	struct stat st;
+	if (fstat(fd, &st))
+		return OL_FCNTL;
+	if (!S_ISREG(st.st_mode))
+		// Pipes, terminals and sockets do not support record locks and there is
+		// no file position to be shared. Single write is the best we can do.
+		return OL_NONE;
+	int fl = fcntl(fd, F_GETFL);
+	if (fl != -1 && fl & O_APPEND)
+		return OL_APPEND;
+	return OL_FCNTL;
+}
+
+static enum output_lock flags_lock(int flags, int fd) {
+	if (flags & LOG_F_LOCK_FCNTL)
+		return OL_FCNTL;
+	if (flags & LOG_F_LOCK_FLOCK)
+		return OL_FLOCK;
+	if (flags & LOG_F_LOCK_APPEND)
+		return OL_APPEND;
+	if (flags & LOG_F_LOCK_MUTEX)
+		return OL_MUTEX;
+	if (flags & LOG_F_LOCK_NONE)
+		return OL_NONE;
+	return default_lock(fd);
+}
 
 void new_output_f(struct output *out, FILE *f, int level, const struct format *format, int flags) {
 	*out = (struct output){
 		.f = f,
 		.fd = -1,
 		.level = level,
-		.format = format,
-		.free_format = false,
 		.use_colors = (flags & LOG_F_COLORS) && !(flags & LOG_F_NO_COLORS),
 		.is_terminal = false,
 		.autoclose = flags & LOG_F_AUTOCLOSE,
@@ -21,135 +54,395 @@ void new_output_f(struct output *out, FILE *f, int level, const struct format *f
 	out->fd = fileno(f);
 	if (out->fd != -1)
 		out->is_terminal = isatty(out->fd);
-	errno = 0; // annul possible fileno and isatty errors
+	out->lock = flags_lock(flags, out->fd);
+	if (out->fd == -1 && (out->lock == OL_FLOCK || out->lock == OL_FCNTL))
+		out->lock = OL_NONE; // There is no file to lock
+	if (out->lock == OL_MUTEX) {
+		out->mutex = malloc(sizeof *out->mutex);
+		pthread_mutex_init(out->mutex, NULL);
+	}
+	errno = 0; // annul possible fileno, isatty and fstat errors
 
 	if (!(flags & (LOG_F_NO_COLORS | LOG_F_COLORS)))
 		out->use_colors = out->is_terminal;
+
+	if (format)
+		format_set_init(&out->format, format, out->is_terminal, out->use_colors);
+	else
+		out->binary = binary_new();
+	if (format && flags & LOG_F_DEDUP)
+		out->dedup = calloc(1, sizeof *out->dedup);
+
+	if (flags & (LOG_F_BUFFER | LOG_F_BUFFER_TIMER))
+		out->buffer = buffer_new(out, flags & LOG_F_BUFFER_TIMER);
+
+	if (flags & (LOG_F_ASYNC | LOG_F_ASYNC_DROP_NEWEST | LOG_F_ASYNC_DROP_OLDEST |
+				LOG_F_ASYNC_DEFERRED | LOG_F_IO_URING)) {
+		enum async_policy policy = AP_BLOCK;
+		if (flags & LOG_F_ASYNC_DROP_OLDEST)
+			policy = AP_DROP_OLDEST;
+		else if (flags & LOG_F_ASYNC_DROP_NEWEST)
+			policy = AP_DROP_NEWEST;
+		out->deferred = flags & LOG_F_ASYNC_DEFERRED;
+		out->async = async_new(out, policy, flags & LOG_F_IO_URING);
+	}
 }
 
 void new_output(struct output *out, FILE *f, int level, const char *format, int flags) {
 	struct format *fformat = parse_format(format);
 	new_output_f(out, f, level, fformat, flags);
-	out->free_format = true;
+	free_format(fformat);
 }
 
 void free_output(struct output *out, bool close_f) {
 	if (!out)
 		return;
+	async_free(out->async);
+	buffer_free(out->buffer);
+	binary_free(out->binary);
+	free(out->dedup);
+	compress_free(out->compress);
+	mapfile_free(out->mapfile);
 	if (close_f && out->autoclose)
 		fclose(out->f);
-	if (out->free_format)
-		free_format((struct format*)out->format);
+	rotate_free(out->rotate);
+	format_set_free(&out->format);
+	if (out->mutex) {
+		pthread_mutex_destroy(out->mutex);
+		free(out->mutex);
+	}
 }
 
-void syslog_output(struct output *out, char **str, size_t *str_len,
-		const struct format *format) {
+static struct format_set default_syslog_format_set;
+static pthread_once_t default_syslog_format_once = PTHREAD_ONCE_INIT;
+
+static void default_syslog_format_init() {
+	format_set_init(&default_syslog_format_set, default_format(), false, false);
+}
+
+static const struct format_set *default_syslog_format() {
+	pthread_once(&default_syslog_format_once, default_syslog_format_init);
+	return &default_syslog_format_set;
+}
+
+void syslog_output(struct output *out, const struct format_set *format) {
 	*out = (struct output){
-		.f = open_memstream(str, str_len),
+		.f = NULL,
 		.fd = -1,
 		.level = 0,
-		.format = format ?: default_format(),
+		.format = *(format ?: default_syslog_format()),
 		.use_colors = false,
 		.is_terminal = false,
 		.autoclose = false,
 	};
 }
 
-void log_add_output(log_t log, FILE *file, int flags, int level, const char *format) {
-	log_allocate(log);
-	size_t index = log->_log->outs_cnt;
-	for (size_t i = 0; i < log->_log->outs_cnt; i++) // Locate if already present
-		if (file == log->_log->outs[i].f) {
-			free_output(log->_log->outs + i, false);
+void output_write(const struct output *out, const char *data, size_t len) {
+	if (out->compress) {
+		compress_write(out->compress, data, len);
+		return;
+	}
+	if (out->mapfile) {
+		mapfile_write(out->mapfile, data, len);
+		return;
+	}
+	if (out->fd == -1) {
+		fwrite(data, 1, len, out->f);
+		fflush(out->f);
+		return;
+	}
+	// Data written to FILE directly has to precede our line
+	fflush(out->f);
+	if (out->rotate)
+		rotate_check(out->rotate, len);
+	size_t written = len;
+	while (len > 0) {
+		ssize_t res = write(out->fd, data, len);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			break; // There is nothing we can do about it
+		}
+		data += res;
+		len -= res;
+	}
+	if (out->rotate)
+		rotate_written(out->rotate, written - len);
+	errno = 0; // ignore failure
+}
+
+void output_emit(const struct output *out, const char *data, size_t len, bool urgent) {
+	if (out->async && async_write(out->async, data, len))
+		return;
+	if (out->buffer) {
+		buffer_write(out->buffer, data, len, urgent);
+		return;
+	}
+	lock_output(out);
+	output_write(out, data, len);
+	unlock_output(out);
+}
+
+static void add_output(log_t log, struct output *out) {
+	FILE *file = out->f;
+	struct log_config *config = config_edit(log);
+	struct output *old = NULL;
+	size_t index = config->outs_cnt;
+	for (size_t i = 0; i < config->outs_cnt; i++) // Locate if already present
+		if (file == config->outs[i]->f) {
+			old = config->outs[i];
 			index = i;
 			break;
 		}
 
 	// We do not expect huge amount of outputs so optimizing addition to array for
 	// speed is less beneficial over optimizing for memory (fitting exactly)
-	if (index == log->_log->outs_cnt)
-		log->_log->outs = realloc(log->_log->outs,
-				++log->_log->outs_cnt * sizeof(struct output));
+	if (index == config->outs_cnt)
+		config->outs = realloc(config->outs, ++config->outs_cnt * sizeof *config->outs);
+	config->outs[index] = out;
+	config_commit(log, config);
+
+	if (old) {
+		free_output(old, false);
+		free(old);
+	}
+}
+
+void log_add_output(log_t log, FILE *file, int flags, int level, const char *format) {
+	struct output *out = malloc(sizeof *out);
+	new_output(out, file, level, format, flags);
+	add_output(log, out);
+}
+
+void log_add_binary_output(log_t log, FILE *file, int flags, int level) {
+	struct output *out = malloc(sizeof *out);
+	new_output_f(out, file, level, NULL, flags);
+	add_output(log, out);
+}
+
+// Outputs that process lines in output_write can't use io_uring
+static int no_uring(int flags) {
+	if (flags & LOG_F_IO_URING)
+		return (flags & ~LOG_F_IO_URING) | LOG_F_ASYNC;
+	return flags;
+}
+
+FILE *log_add_file_output(log_t log, const char *path, int flags, int level,
+		const char *format, const struct log_rotation *rotation) {
+	struct rotate *rot = rotate_new(path, rotation);
+	if (rot == NULL)
+		return NULL;
+	FILE *file = fdopen(rotate_fd(rot), "a");
+	if (file == NULL) {
+		close(rotate_fd(rot));
+		rotate_free(rot);
+		return NULL;
+	}
+	struct output *out = malloc(sizeof *out);
+	new_output(out, file, level, format, no_uring(flags) | LOG_F_AUTOCLOSE);
+	out->rotate = rot;
+	add_output(log, out);
+	return file;
+}
+
+FILE *log_add_compressed_output(log_t log, const char *path, int flags, int level,
+		const char *format, const struct log_compression *compression) {
+	struct compress *comp = compress_new(path, compression);
+	if (comp == NULL)
+		return NULL;
+	FILE *file = fdopen(compress_fd(comp), "a");
+	if (file == NULL) {
+		close(compress_fd(comp));
+		compress_free(comp);
+		return NULL;
+	}
+	flags = no_uring(flags);
+	struct output *out = malloc(sizeof *out);
+	if (format)
+		new_output(out, file, level, format, flags | LOG_F_AUTOCLOSE);
+	else
+		new_output_f(out, file, level, NULL, flags | LOG_F_AUTOCLOSE);
+	out->compress = comp;
+	add_output(log, out);
+	return file;
+}
+
+FILE *log_add_mmap_output(log_t log, const char *path, int flags, int level,
+		const char *format, const struct log_mmap *mmap) {
+	struct mapfile *map = mapfile_new(path, mmap, format != NULL);
+	if (map == NULL)
+		return NULL;
+	FILE *file = fdopen(mapfile_fd(map), "r+");
+	if (file == NULL) {
+		close(mapfile_fd(map));
+		mapfile_free(map);
+		return NULL;
+	}
+	// Space in mapping is reserved atomically so there is nothing to lock
+	flags &= ~(LOG_F_LOCK_MUTEX | LOG_F_LOCK_APPEND | LOG_F_LOCK_FLOCK | LOG_F_LOCK_FCNTL);
+	flags = no_uring(flags);
+	struct output *out = malloc(sizeof *out);
+	if (format)
+		new_output(out, file, level, format, flags | LOG_F_AUTOCLOSE | LOG_F_LOCK_NONE);
+	else
+		new_output_f(out, file, level, NULL, flags | LOG_F_AUTOCLOSE | LOG_F_LOCK_NONE);
+	out->mapfile = map;
+	add_output(log, out);
+	return file;
+}
 
-	new_output(log->_log->outs + index, file, level, format, flags);
+size_t log_output_dropped(log_t log, FILE *file) {
+	size_t res = 0;
+	config_read_lock();
+	const struct log_config *config = log_config(log);
+	for (size_t i = 0; i < config->outs_cnt; i++)
+		if (config->outs[i]->f == file) {
+			if (config->outs[i]->async)
+				res += async_dropped(config->outs[i]->async);
+			if (config->outs[i]->mapfile)
+				res += mapfile_dropped(config->outs[i]->mapfile);
+		}
+	config_read_unlock();
+	return res;
 }
 
 bool log_rm_output(log_t log, FILE *file) {
-	log_allocate(log);
-	for (size_t i = 0; i < log->_log->outs_cnt; i++) {
-		struct output *out = log->_log->outs + i;
-		if (out->f == file) {
-			free_output(out, true);
-			log->_log->outs_cnt--;
-			memmove(out, out + 1, (log->_log->outs_cnt - i) * sizeof *out);
-			log->_log->outs = realloc(log->_log->outs,
-				log->_log->outs_cnt * sizeof *out);
-			return true;
+	struct log_config *config = config_edit(log);
+	struct output *out = NULL;
+	for (size_t i = 0; i < config->outs_cnt; i++) {
+		if (config->outs[i]->f == file) {
+			out = config->outs[i];
+			config->outs_cnt--;
+			memmove(config->outs + i, config->outs + i + 1,
+					(config->outs_cnt - i) * sizeof *config->outs);
+			break;
 		}
 	}
-	return false;
+	config_commit(log, config);
+	if (out == NULL)
+		return false;
+	free_output(out, true);
+	free(out);
+	return true;
 }
 
 void log_wipe_outputs(log_t log) {
 	if (!log->_log)
 		return;
-	for (size_t i = 0; i < log->_log->outs_cnt; i++)
-		free_output(log->_log->outs + i, true);
-	free(log->_log->outs);
-	log->_log->outs_cnt = 0;
-	log->_log->outs = NULL;
+	struct log_config *config = config_edit(log);
+	struct output **outs = config->outs;
+	size_t outs_cnt = config->outs_cnt;
+	config->outs = NULL;
+	config->outs_cnt = 0;
+	config_commit(log, config);
+	for (size_t i = 0; i < outs_cnt; i++) {
+		free_output(outs[i], true);
+		free(outs[i]);
+	}
+	free(outs);
 }
 
 void log_stderr_fallback(log_t log, bool enabled) {
-	log_allocate(log);
-	log->_log->no_stderr = !enabled;
+	struct log_config *config = config_edit(log);
+	config->no_stderr = !enabled;
+	config_commit(log, config);
 }
 
 void log_flush(log_t log) {
-	if (log->_log)
-		for (size_t i = 0; i < log->_log->outs_cnt; i++)
-			fflush(log->_log->outs[i].f);
+	config_read_lock();
+	const struct log_config *config = log_config(log);
+	for (size_t i = 0; i < config->outs_cnt; i++) {
+		struct dedup_summary summary;
+		if (config->outs[i]->dedup && dedup_take(config->outs[i]->dedup, &summary)) {
+			struct record r;
+			record_init(&r);
+			struct log_time time = {0};
+			dedup_render(&r, config->outs[i], &summary, &time);
+			output_emit(config->outs[i], r.data, r.len, false);
+			record_free(&r);
+		}
+		if (config->outs[i]->async)
+			async_flush(config->outs[i]->async);
+		if (config->outs[i]->buffer)
+			buffer_flush(config->outs[i]->buffer);
+		if (config->outs[i]->compress)
+			compress_flush(config->outs[i]->compress);
+		if (config->outs[i]->mapfile)
+			mapfile_sync(config->outs[i]->mapfile);
+		fflush(config->outs[i]->f);
+	}
+	config_read_unlock();
 	fflush(stderr); // alway flush stderr to cover cases when outs were just added
 };
 
+// Output for stderr is replaced when stderr is changed. The previous ones are
+// kept as other threads might still use them.
+struct stderr_output {
+	struct output out;
+	struct stderr_output *prev;
+};
+static struct stderr_output *stderr_output = NULL;
+
 const struct output *default_stderr_output() {
-	static struct output *out = NULL;
-	if (out && out->f != stderr) {
-		free_output(out, false);
-		out = NULL;
-	}
-	if (out == NULL) {
-		out = malloc(sizeof *out);
-		new_output_f(out, stderr, 0, default_format(), 0);
+	struct stderr_output *cur = __atomic_load_n(&stderr_output, __ATOMIC_ACQUIRE);
+	while (cur == NULL || cur->out.f != stderr) {
+		struct stderr_output *new = malloc(sizeof *new);
+		new_output_f(&new->out, stderr, 0, default_format(), 0);
+		new->prev = cur;
+		if (__atomic_compare_exchange_n(&stderr_output, &new->prev, new, false,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return &new->out;
+		// Other thread was faster
+		cur = new->prev;
+		free_output(&new->out, false);
+		free(new);
 	}
-	return out;
+	return &cur->out;
 }
 
 
-void lock_output(const struct output *out) {
-	if (out->fd == -1)
-		return;
-
+static void fcntl_lock(int fd, short type) {
 	struct flock fl = {
-		.l_type = F_WRLCK,
+		.l_type = type,
 		.l_whence = SEEK_SET,
 		.l_start = 0,
 		.l_len = 0,
 	};
-	fcntl(out->fd, F_SETLKW, &fl);
+	fcntl(fd, F_SETLKW, &fl);
+}
+
+void lock_output(const struct output *out) {
+	switch (out->lock) {
+		case OL_NONE:
+		case OL_APPEND:
+			return;
+		case OL_MUTEX:
+			pthread_mutex_lock(out->mutex);
+			return;
+		case OL_FLOCK:
+			flock(out->fd, LOCK_EX);
+			break;
+		case OL_FCNTL:
+			fcntl_lock(out->fd, F_WRLCK);
+			break;
+	}
 	errno = 0; // ignore failure
 }
 
 void unlock_output(const struct output *out) {
-	if (out->fd == -1)
-		return;
-
-	struct flock fl = {
-		.l_type = F_UNLCK,
-		.l_whence = SEEK_SET,
-		.l_start = 0,
-		.l_len = 0,
-	};
-	fcntl(out->fd, F_SETLKW, &fl);
+	switch (out->lock) {
+		case OL_NONE:
+		case OL_APPEND:
+			return;
+		case OL_MUTEX:
+			pthread_mutex_unlock(out->mutex);
+			return;
+		case OL_FLOCK:
+			flock(out->fd, LOCK_UN);
+			break;
+		case OL_FCNTL:
+			fcntl_lock(out->fd, F_UNLCK);
+			break;
+	}
 	errno = 0; // ignore failure
 }
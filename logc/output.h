@@ -5,26 +5,62 @@
 #include "log.h"
 #include <logc.h>
 #include <sys/types.h>
+#include <pthread.h>
 #include "format.h"
+#include "async.h"
+#include "binary.h"
+#include "dedup.h"
+#include "rotate.h"
+#include "compress.h"
+#include "mapfile.h"
+#include "buffer.h"
+
+enum output_lock {
+	OL_NONE,
+	OL_MUTEX,
+	OL_APPEND,
+	OL_FLOCK,
+	OL_FCNTL,
+};
 
 struct output {
 	FILE *f;
 	int fd;
 	int level;
-	const struct format *format;
-	bool free_format;
+	struct format_set format;
 	bool use_colors;
 	bool is_terminal;
 	bool autoclose;
+	enum output_lock lock;
+	pthread_mutex_t *mutex; // allocated only for OL_MUTEX
+	struct async *async; // only for asynchronous output
+	bool deferred; // message is formatted by writer of asynchronous output
+	struct binary *binary; // only for binary output
+	struct dedup *dedup; // only for LOG_F_DEDUP
+	struct rotate *rotate; // only for file output (log_add_file_output)
+	struct compress *compress; // only for log_add_compressed_output
+	struct mapfile *mapfile; // only for log_add_mmap_output
+	struct buffer *buffer; // only for LOG_F_BUFFER
 };
 
 void new_output(struct output *out, FILE *f, int level,
 		const char *format, int flags);
+// Binary output is created if format is NULL
+void new_output_f(struct output *out, FILE *f, int level,
+		const struct format *format, int flags);
 void free_output(struct output *out, bool close_f);
 
-void syslog_output(struct output *out, char **str, size_t *str_len,
-		const struct format *format);
-void free_syslog_output(struct output *out);
+// Output used to render syslog messages. It has no file.
+void syslog_output(struct output *out, const struct format_set *format);
+
+// Write complete log line to output. The line is written with single write
+// call if output has file descriptor so lines are never interleaved.
+void output_write(const struct output *out, const char *data, size_t len);
+
+// Output complete log line. It is either queued for asynchronous output, buffered
+// or written to the output while it is locked. Urgent line is never left in
+// buffer.
+void output_emit(const struct output *out, const char *data, size_t len, bool urgent);
 
 const struct output *default_stderr_output();
 
@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "ratelimit.h"
+#include <time.h>
+
+// Token bucket is implemented as generic cell rate algorithm. The whole state is
+// the time at which bucket is full again so it can be updated with single
+// compare and swap. The time is in milliseconds in a machine word and thus it
+// overflows (on 32-bit in 49 days). Only differences are compared so this is not
+// an issue. Bucket is never full more than interval ahead and thus larger
+// difference means that it is full already.
+bool ratelimit_pass(struct log_ratelimit *rl, size_t *suppressed) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	unsigned long now = (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	unsigned long interval = rl->interval;
+	unsigned long period = interval / (rl->burst ?: 1) ?: 1; // time to regain single token
+	unsigned long tolerance = interval > period ? interval - period : 0;
+
+	unsigned long full = __atomic_load_n(&rl->_full, __ATOMIC_RELAXED);
+	unsigned long next;
+	do {
+		next = full - now <= interval ? full : now;
+		if (next - now > tolerance) {
+			__atomic_add_fetch(&rl->_suppressed, 1, __ATOMIC_RELAXED);
+			return false;
+		}
+	} while (!__atomic_compare_exchange_n(&rl->_full, &full, next + period, true,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	*suppressed = __atomic_exchange_n(&rl->_suppressed, 0, __ATOMIC_RELAXED);
+	return true;
+}
@@ -0,0 +1,13 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_RATELIMIT_H_
+#define _LOGC_RATELIMIT_H_
+#include <logc.h>
+
+// Take token from the bucket of rate limited message. Returns false if message
+// has to be suppressed. Otherwise number of messages suppressed since the last
+// passed one is provided in suppressed.
+bool ratelimit_pass(struct log_ratelimit *rl, size_t *suppressed)
+	__attribute__((nonnull));
+
+#endif
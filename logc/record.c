@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "record.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+void record_init(struct record *r) {
+	r->data = r->stack;
+	r->len = 0;
+	r->size = RECORD_STACK_SIZE;
+}
+
+void record_free(struct record *r) {
+	if (r->data != r->stack)
+		free(r->data);
+	record_init(r);
+}
+
+void record_reserve(struct record *r, size_t len) {
+	if (r->len + len <= r->size)
+		return;
+	size_t size = r->size;
+	while (r->len + len > size)
+		size *= 2;
+	if (r->data == r->stack) {
+		r->data = malloc(size);
+		memcpy(r->data, r->stack, r->len);
+	} else
+		r->data = realloc(r->data, size);
+	r->size = size;
+}
+
+void record_printf(struct record *r, const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	int len = vsnprintf(r->data + r->len, r->size - r->len, format, args);
+	va_end(args);
+	if (len < 0)
+		return;
+	if (r->len + len >= r->size) {
+		record_reserve(r, len + 1);
+		va_start(args, format);
+		vsnprintf(r->data + r->len, r->size - r->len, format, args);
+		va_end(args);
+	}
+	r->len += len;
+}
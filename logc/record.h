@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_RECORD_H_
+#define _LOGC_RECORD_H_
+#include <stddef.h>
+#include <string.h>
+
+// Most of the records fit to the stack buffer and thus there is no allocation.
+#define RECORD_STACK_SIZE 512
+
+// Buffer a complete log line is assembled in before it is written out
+struct record {
+	char *data;
+	size_t len;
+	size_t size;
+	char stack[RECORD_STACK_SIZE];
+};
+
+// Initialize or reset record to be empty
+void record_init(struct record *r) __attribute__((nonnull));
+// Free memory possibly allocated by record
+void record_free(struct record *r) __attribute__((nonnull));
+
+// Ensure that there is space for at least given amount of additional bytes
+void record_reserve(struct record *r, size_t len) __attribute__((nonnull));
+
+static inline void record_append(struct record *r, const char *str, size_t len) {
+	if (r->len + len > r->size)
+		record_reserve(r, len);
+	memcpy(r->data + r->len, str, len);
+	r->len += len;
+}
+
+static inline void record_puts(struct record *r, const char *str) {
+	record_append(r, str, strlen(str));
+}
+
+void record_printf(struct record *r, const char *format, ...)
+	__attribute__((nonnull, format(printf, 2, 3)));
+
+#endif
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "recorder.h"
+#include "log.h"
+#include "level.h"
+#include "config.h"
+#include "deferred.h"
+#include "record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+
+#define SLOT_SIZE 512
+// Messages that can't be captured are formatted and truncated to this size
+#define TEXT_SIZE 256
+
+struct slot {
+	size_t seq; // 2 * pos + 1 while it is written and 2 * pos + 2 once written
+	size_t len;
+	char data[SLOT_SIZE - 2 * sizeof(size_t)];
+};
+
+struct recorder {
+	log_t log;
+	struct recorder *next;
+	size_t size;
+	size_t pos; // position of the next message
+	size_t dumped; // position up to which messages were dumped
+	struct slot slots[];
+};
+
+// All recorders so they can be dumped by crash handler
+static struct recorder *recorders = NULL;
+static pthread_mutex_t recorders_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static struct recorder *recorder_new(log_t log, size_t entries) {
+	struct recorder *rec = calloc(1, sizeof *rec + entries * sizeof *rec->slots);
+	rec->log = log;
+	rec->size = entries;
+	pthread_mutex_lock(&recorders_mutex);
+	rec->next = recorders;
+	__atomic_store_n(&recorders, rec, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&recorders_mutex);
+	return rec;
+}
+
+void recorder_free(struct recorder *rec) {
+	if (rec == NULL)
+		return;
+	pthread_mutex_lock(&recorders_mutex);
+	for (struct recorder **r = &recorders; *r; r = &(*r)->next)
+		if (*r == rec) {
+			__atomic_store_n(r, rec->next, __ATOMIC_RELEASE);
+			break;
+		}
+	pthread_mutex_unlock(&recorders_mutex);
+	free(rec);
+}
+
+static bool capture_text(struct record *r, const struct deferred *header,
+		const char *name, ...) {
+	va_list args;
+	va_start(args, name);
+	bool res = deferred_capture(r, header, name, "%s", args);
+	va_end(args);
+	return res;
+}
+
+void recorder_record(struct recorder *rec, const struct deferred *header,
+		const char *name, const char *format, va_list args, bool no_alloc) {
+	struct record r;
+	record_init(&r);
+	va_list cargs;
+	bool captured = false;
+	if (format && !no_alloc) {
+		va_copy(cargs, args);
+		captured = deferred_capture(&r, header, name, format, cargs);
+		va_end(cargs);
+	}
+	if (!captured || r.len > sizeof rec->slots->data) {
+		// Text is limited so that whole capture fits to the slot and thus record
+		// does not allocate (header, name, "%s" format, null flag and terminator).
+		size_t overhead = sizeof *header + strlen(name) + 1 + sizeof "%s" + 2;
+		if (overhead > sizeof rec->slots->data) {
+			record_free(&r);
+			return;
+		}
+		char text[TEXT_SIZE] = "";
+		size_t text_size = sizeof text;
+		if (text_size > sizeof rec->slots->data - overhead + 1)
+			text_size = sizeof rec->slots->data - overhead + 1;
+		if (format) {
+			va_copy(cargs, args);
+			errno = header->stderrno; // for %m
+			vsnprintf(text, text_size, format, cargs);
+			va_end(cargs);
+		}
+		r.len = 0;
+		capture_text(&r, header, name, text);
+	}
+
+	size_t pos = __atomic_fetch_add(&rec->pos, 1, __ATOMIC_RELAXED);
+	struct slot *slot = &rec->slots[pos % rec->size];
+	size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+	// Message is dropped if the slot is being written by writer that is one whole
+	// ring behind or ahead of us
+	if (r.len <= sizeof slot->data && !(seq & 1) &&
+			__atomic_compare_exchange_n(&slot->seq, &seq, 2 * pos + 1, false,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		slot->len = r.len;
+		memcpy(slot->data, r.data, r.len);
+		__atomic_store_n(&slot->seq, 2 * pos + 2, __ATOMIC_RELEASE);
+	}
+	record_free(&r);
+}
+
+// Copy message recorded at given position. Returns false if it was overwritten.
+static bool slot_read(const struct recorder *rec, size_t pos, char *data, size_t *len) {
+	const struct slot *slot = &rec->slots[pos % rec->size];
+	size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+	if (seq != 2 * pos + 2)
+		return false;
+	*len = slot->len;
+	if (*len > sizeof slot->data)
+		return false;
+	memcpy(data, slot->data, *len);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+// Call callback for every message recorded since the given position
+static void recorder_foreach(const struct recorder *rec, size_t from,
+		void (*callback)(const char *data, size_t len, void *arg), void *arg) {
+	size_t end = __atomic_load_n(&rec->pos, __ATOMIC_ACQUIRE);
+	if (end - from > rec->size)
+		from = end - rec->size;
+	char data[sizeof rec->slots->data];
+	size_t len;
+	for (size_t pos = from; pos < end; pos++)
+		if (slot_read(rec, pos, data, &len))
+			callback(data, len, arg);
+}
+
+struct dump {
+	int level_offset;
+	const struct log_config *config;
+	struct output *const *outs;
+	size_t cnt;
+	bool crash;
+	struct record record;
+};
+
+static void dump_message(const char *data, size_t len, void *arg) {
+	struct dump *dump = arg;
+	struct deferred header;
+	if (len < sizeof header)
+		return;
+	memcpy(&header, data, sizeof header);
+	for (size_t i = 0; i < dump->cnt; i++) {
+		const struct output *out = dump->outs[i];
+		// Binary outputs have no format and messages that passed verbosity were
+		// already outputted
+		if (out->binary ||
+				verbose_filter(header.level - dump->level_offset, dump->config, out))
+			continue;
+		dump->record.len = 0;
+		if (!deferred_render(&dump->record, out, data, len))
+			return;
+		if (dump->crash)
+			output_write(out, dump->record.data, dump->record.len);
+		else
+			output_emit(out, dump->record.data, dump->record.len, false);
+	}
+}
+
+void recorder_dump(log_t log, const struct log_config *config, bool crash) {
+	struct recorder *rec = config->recorder;
+	if (rec == NULL)
+		return;
+	struct dump dump = {.crash = crash};
+	// Traverse to top level dominator as messages are outputted by it
+	while (config->dominator) {
+		dump.level_offset += config->level;
+		config = log_config(config->dominator);
+	}
+	dump.config = config;
+	const struct output *stderr_output = default_stderr_output();
+	dump.outs = (struct output *const *)&stderr_output;
+	dump.cnt = config->no_stderr ? 0 : 1;
+	if (config->outs_cnt) {
+		dump.outs = config->outs;
+		dump.cnt = config->outs_cnt;
+	}
+	record_init(&dump.record);
+	size_t from = __atomic_exchange_n(&rec->dumped,
+			__atomic_load_n(&rec->pos, __ATOMIC_ACQUIRE), __ATOMIC_ACQ_REL);
+	recorder_foreach(rec, from, dump_message, &dump);
+	record_free(&dump.record);
+}
+
+void log_set_recorder(log_t log, size_t entries) {
+	struct recorder *rec = entries ? recorder_new(log, entries) : NULL;
+	struct log_config *config = config_edit(log);
+	struct recorder *old = config->recorder;
+	config->recorder = rec;
+	config_commit(log, config);
+	recorder_free(old);
+}
+
+void log_recorder_dump(log_t log) {
+	config_read_lock();
+	recorder_dump(log, log_config(log), false);
+	config_read_unlock();
+}
+
+struct lines {
+	struct output out;
+	void (*callback)(const char *line, size_t len, void *data);
+	void *data;
+	size_t cnt;
+	struct record record;
+};
+
+static void render_message(const char *data, size_t len, void *arg) {
+	struct lines *lines = arg;
+	lines->record.len = 0;
+	if (!deferred_render(&lines->record, &lines->out, data, len))
+		return;
+	lines->callback(lines->record.data, lines->record.len, lines->data);
+	lines->cnt++;
+}
+
+size_t log_recorder_foreach(log_t log, const char *format,
+		void (*callback)(const char *line, size_t len, void *data), void *data) {
+	struct format *fformat = parse_format(format);
+	struct format_set set;
+	format_set_init(&set, fformat, false, false);
+	free_format(fformat);
+	struct lines lines = {
+		.callback = callback,
+		.data = data,
+	};
+	syslog_output(&lines.out, &set);
+	record_init(&lines.record);
+
+	config_read_lock();
+	const struct log_config *config = log_config(log);
+	if (config->recorder)
+		recorder_foreach(config->recorder, 0, render_message, &lines);
+	config_read_unlock();
+
+	record_free(&lines.record);
+	format_set_free(&set);
+	return lines.cnt;
+}
+
+static const int crash_signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+
+static void crash_handler(int sig) {
+	int err = errno;
+	for (struct recorder *rec = __atomic_load_n(&recorders, __ATOMIC_ACQUIRE); rec;
+			rec = __atomic_load_n(&rec->next, __ATOMIC_ACQUIRE)) {
+		config_read_lock();
+		const struct log_config *config = log_config(rec->log);
+		if (config->recorder == rec)
+			recorder_dump(rec->log, config, true);
+		config_read_unlock();
+	}
+	errno = err;
+	// Handler was reset to default so signal terminates the program
+	raise(sig);
+}
+
+bool log_recorder_on_crash() {
+	struct sigaction sa = {
+		.sa_handler = crash_handler,
+		.sa_flags = SA_RESETHAND | SA_NODEFER,
+	};
+	sigemptyset(&sa.sa_mask);
+	for (size_t i = 0; i < sizeof crash_signals / sizeof *crash_signals; i++)
+		if (sigaction(crash_signals[i], &sa, NULL))
+			return false;
+	return true;
+}
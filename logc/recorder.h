@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_RECORDER_H_
+#define _LOGC_RECORDER_H_
+#include <logc.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+struct log_config;
+struct deferred;
+
+// Flight recorder of log (log_set_recorder). It is a ring of fixed size slots with
+// messages captured by deferred_capture. Slots are written without any lock and
+// every slot is guarded by sequence number so readers skip slots that are being
+// overwritten.
+struct recorder;
+
+// Free recorder. Log has to be no longer using it.
+void recorder_free(struct recorder *rec);
+
+// Record message of log. Message is not formatted unless format can't be
+// captured or no_alloc is set. With no_alloc the message is formatted to fixed
+// size buffer and nothing is allocated (use in signal handlers).
+void recorder_record(struct recorder *rec, const struct deferred *header,
+		const char *name, const char *format, va_list args, bool no_alloc)
+	__attribute__((nonnull(1, 2, 3)));
+
+// Write messages recorded by log to its outputs. Every output receives only
+// messages that it did not output because of its verbosity. In crash the lines
+// are written directly to outputs without queues and buffers.
+void recorder_dump(log_t log, const struct log_config *config, bool crash)
+	__attribute__((nonnull));
+
+#endif
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "rotate.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define OPEN_FLAGS (O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC)
+#define OPEN_MODE 0666
+
+// Reopen of all files is requested by increment of this counter
+static unsigned reopen_generation = 0;
+
+struct rotate {
+	char *path;
+	// Paths of rotated files (path.1 to path.keep). They are prepared in advance
+	// so no allocation is required while rotating.
+	char **rotated;
+	struct log_rotation policy;
+	int fd;
+	size_t size;
+	time_t opened;
+	unsigned generation; // reopen_generation at the time of last reopen
+	bool busy; // rotation or reopen is in progress
+};
+
+static time_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+	return ts.tv_sec;
+}
+
+// Place new file on output's file descriptor. Writing continues to the previous
+// file if new one can't be opened.
+static void reopen(struct rotate *rot) {
+	int fd = open(rot->path, OPEN_FLAGS, OPEN_MODE);
+	if (fd == -1)
+		return;
+	dup2(fd, rot->fd);
+	close(fd);
+	struct stat st;
+	__atomic_store_n(&rot->size, fstat(rot->fd, &st) ? 0 : (size_t)st.st_size,
+			__ATOMIC_RELAXED);
+	__atomic_store_n(&rot->opened, now(), __ATOMIC_RELAXED);
+}
+
+static void rotate_files(struct rotate *rot) {
+	unsigned keep = rot->policy.keep;
+	if (keep == 0) {
+		unlink(rot->path);
+	} else {
+		for (unsigned i = keep - 1; i > 0; i--)
+			if (rot->rotated[i - 1] && rot->rotated[i])
+				rename(rot->rotated[i - 1], rot->rotated[i]);
+		if (rot->rotated[0])
+			rename(rot->path, rot->rotated[0]);
+	}
+	reopen(rot);
+}
+
+struct rotate *rotate_new(const char *path, const struct log_rotation *policy) {
+	int fd = open(path, OPEN_FLAGS, OPEN_MODE);
+	if (fd == -1)
+		return NULL;
+	struct rotate *rot = malloc(sizeof *rot);
+	*rot = (struct rotate){
+		.path = strdup(path),
+		.fd = fd,
+		.opened = now(),
+		.generation = __atomic_load_n(&reopen_generation, __ATOMIC_RELAXED),
+	};
+	if (policy)
+		rot->policy = *policy;
+	struct stat st;
+	if (!fstat(fd, &st))
+		rot->size = st.st_size;
+	if (rot->policy.keep) {
+		rot->rotated = malloc(rot->policy.keep * sizeof *rot->rotated);
+		for (unsigned i = 0; i < rot->policy.keep; i++)
+			if (asprintf(&rot->rotated[i], "%s.%u", path, i + 1) == -1)
+				rot->rotated[i] = NULL;
+	}
+	return rot;
+}
+
+void rotate_free(struct rotate *rot) {
+	if (rot == NULL)
+		return;
+	for (unsigned i = 0; i < rot->policy.keep; i++)
+		free(rot->rotated[i]);
+	free(rot->rotated);
+	free(rot->path);
+	free(rot);
+}
+
+int rotate_fd(const struct rotate *rot) {
+	return rot->fd;
+}
+
+void rotate_check(struct rotate *rot, size_t len) {
+	unsigned generation = __atomic_load_n(&reopen_generation, __ATOMIC_RELAXED);
+	bool do_reopen = generation != __atomic_load_n(&rot->generation, __ATOMIC_RELAXED);
+	size_t size = __atomic_load_n(&rot->size, __ATOMIC_RELAXED);
+	// Empty file is never rotated and thus line longer than the size limit is
+	// written to its own file.
+	bool do_rotate = size &&
+		((rot->policy.max_size && size + len > rot->policy.max_size) ||
+		 (rot->policy.max_age &&
+		  now() - __atomic_load_n(&rot->opened, __ATOMIC_RELAXED) >= rot->policy.max_age));
+	if (!do_reopen && !do_rotate)
+		return;
+
+	bool expected = false;
+	if (!__atomic_compare_exchange_n(&rot->busy, &expected, true, false,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return; // Some other writer is on it
+	int err = errno;
+	__atomic_store_n(&rot->generation, generation, __ATOMIC_RELAXED);
+	if (do_rotate)
+		rotate_files(rot);
+	else
+		reopen(rot);
+	errno = err;
+	__atomic_store_n(&rot->busy, false, __ATOMIC_RELEASE);
+}
+
+void rotate_written(struct rotate *rot, size_t len) {
+	__atomic_add_fetch(&rot->size, len, __ATOMIC_RELAXED);
+}
+
+void log_reopen_files() {
+	__atomic_add_fetch(&reopen_generation, 1, __ATOMIC_RELAXED);
+}
+
+static void sighup_handler(int sig) {
+	log_reopen_files();
+}
+
+bool log_reopen_on_sighup() {
+	struct sigaction sa = {
+		.sa_handler = sighup_handler,
+		.sa_flags = SA_RESTART,
+	};
+	sigemptyset(&sa.sa_mask);
+	return !sigaction(SIGHUP, &sa, NULL);
+}
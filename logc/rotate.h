@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_ROTATE_H_
+#define _LOGC_ROTATE_H_
+#include <logc.h>
+#include <stddef.h>
+
+// State of file output with rotation (log_add_file_output). The file descriptor
+// of output never changes. New file is placed on it with dup2 so writers can
+// always use it without any synchronization.
+struct rotate;
+
+// Open file on given path for rotating output. Returns NULL and sets errno if file
+// can't be opened. The rotation policy can be NULL for no rotation.
+struct rotate *rotate_new(const char *path, const struct log_rotation *policy)
+	__attribute__((nonnull(1)));
+void rotate_free(struct rotate *rot);
+
+// File descriptor of output
+int rotate_fd(const struct rotate *rot) __attribute__((nonnull));
+
+// Rotate or reopen file if it is due before line of given length is written.
+// Only one writer performs it and others continue writing to the previous file.
+// This is async-signal-safe.
+void rotate_check(struct rotate *rot, size_t len) __attribute__((nonnull));
+
+// Account line of given length written to the file
+void rotate_written(struct rotate *rot, size_t len) __attribute__((nonnull));
+
+#endif
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "sampling.h"
+#include <stdint.h>
+#include <time.h>
+#include "config.h"
+
+// Per-thread xorshift64* generator. It is seeded on the first use from address of
+// its state (unique for every thread) and time.
+static __thread uint64_t prng_state = 0;
+
+static uint64_t prng() {
+	if (prng_state == 0) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		prng_state = ((uint64_t)(uintptr_t)&prng_state ^ (uint64_t)ts.tv_nsec ^
+				(uint64_t)ts.tv_sec << 30) * 0x9e3779b97f4a7c15ULL;
+		prng_state = prng_state ?: 1;
+	}
+	prng_state ^= prng_state >> 12;
+	prng_state ^= prng_state << 25;
+	prng_state ^= prng_state >> 27;
+	return prng_state * 0x2545f4914f6cdd1dULL;
+}
+
+unsigned sampling_pass(const struct log_sampling *sampling, size_t *count) {
+	unsigned n = sampling->n;
+	if (sampling->mode == LOG_SAMPLE_ALL || n <= 1)
+		return 1;
+	size_t cnt;
+	switch (sampling->mode) {
+		case LOG_SAMPLE_EVERY:
+			cnt = __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+			return cnt % n == 0 ? n : 0;
+		case LOG_SAMPLE_RANDOM:
+			return prng() % n == 0 ? n : 0;
+		case LOG_SAMPLE_FIRST:
+			cnt = __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+			if (cnt < sampling->first)
+				return 1;
+			return (cnt - sampling->first) % n == 0 ? n : 0;
+		default:
+			return 1;
+	}
+}
+
+void log_set_sampling(log_t log, int level, enum log_sampling_mode mode,
+		unsigned n, unsigned first) {
+	struct log_config *config = config_edit(log);
+	config->sampling_level = level;
+	config->sampling = (struct log_sampling){
+		.mode = mode,
+		.n = n,
+		.first = first,
+	};
+	__atomic_store_n(&log->_log->sample_count, 0, __ATOMIC_RELAXED);
+	config_commit(log, config);
+}
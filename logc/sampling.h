@@ -0,0 +1,13 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_SAMPLING_H_
+#define _LOGC_SAMPLING_H_
+#include <logc.h>
+
+// Decide if message passes sampling. The count is counter of messages subject to
+// this sampling. Returns zero if message has to be dropped and sampling rate of
+// message otherwise (one if message was not sampled).
+unsigned sampling_pass(const struct log_sampling *sampling, size_t *count)
+	__attribute__((nonnull));
+
+#endif
@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "spec.h"
+#include <stdio.h>
+#include <string.h>
+
+bool parse_spec(const char *str, struct spec *spec) {
+	*spec = (struct spec){.precision = -1};
+	const char *c = str + 1;
+	c += strspn(c, "-+ #0'I");
+	if (*c == '*') {
+		spec->width_arg = true;
+		c++;
+	} else
+		c += strspn(c, "0123456789");
+	if (*c == '$')
+		return false; // positional arguments
+	if (*c == '.') {
+		c++;
+		if (*c == '*') {
+			spec->precision_arg = true;
+			c++;
+		} else {
+			spec->precision = 0;
+			for (; *c >= '0' && *c <= '9'; c++)
+				spec->precision = spec->precision * 10 + *c - '0';
+		}
+	}
+	if (c - str > SPEC_MAX)
+		return false;
+
+	enum arg_type integer = AT_INT;
+	bool long_double = false;
+	spec->length_pos = c - str;
+	switch (*c) {
+		case 'h':
+			c += c[1] == 'h' ? 2 : 1;
+			break;
+		case 'l':
+			integer = c[1] == 'l' ? AT_LLONG : AT_LONG;
+			c += c[1] == 'l' ? 2 : 1;
+			break;
+		case 'q':
+			integer = AT_LLONG;
+			c++;
+			break;
+		case 'L':
+			integer = AT_LLONG;
+			long_double = true;
+			c++;
+			break;
+		case 'j':
+			integer = AT_INTMAX;
+			c++;
+			break;
+		case 'z':
+		case 'Z':
+			integer = AT_SIZE;
+			c++;
+			break;
+		case 't':
+			integer = AT_PTRDIFF;
+			c++;
+			break;
+	}
+	spec->length_len = c - str - spec->length_pos;
+
+	switch (*c) {
+		case '%':
+			spec->type = AT_NONE;
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			spec->is_unsigned = true;
+			// falls through
+		case 'd':
+		case 'i':
+			spec->type = integer;
+			break;
+		case 'c':
+			spec->type = AT_INT; // wint_t for %lc is promoted to int as well
+			break;
+		case 's':
+			if (integer != AT_INT)
+				return false; // wide strings
+			spec->type = AT_STR;
+			break;
+		case 'p':
+			spec->type = AT_PTR;
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			spec->type = long_double ? AT_LDOUBLE : AT_DOUBLE;
+			break;
+		default: // %n, %m and unknown conversions
+			return false;
+	}
+	spec->len = c + 1 - str;
+	return spec->len <= SPEC_MAX;
+}
+
+void spec_build(char *buf, const char *str, const struct spec *spec, int width,
+		int precision, const char *length) {
+	char *b = buf;
+	for (size_t i = 0; i < spec->len; i++) {
+		if (length && i == spec->length_pos) {
+			b = stpcpy(b, length);
+			i += spec->length_len;
+		}
+		if (str[i] != '*') {
+			*b++ = str[i];
+			continue;
+		}
+		int value = str[i - 1] == '.' ? precision : width;
+		if (str[i - 1] == '.' && value < 0)
+			b--; // negative precision is as if it was not specified
+		else
+			b += sprintf(b, "%d", value);
+	}
+	*b = '\0';
+}
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_SPEC_H_
+#define _LOGC_SPEC_H_
+#include <stdbool.h>
+#include <stddef.h>
+
+// Type of argument consumed by printf conversion
+enum arg_type {
+	AT_NONE, // conversion without argument (%%)
+	AT_INT,
+	AT_LONG,
+	AT_LLONG,
+	AT_INTMAX,
+	AT_SIZE,
+	AT_PTRDIFF,
+	AT_DOUBLE,
+	AT_LDOUBLE,
+	AT_PTR,
+	AT_STR,
+};
+
+// Longest conversion specification we support (including %)
+#define SPEC_MAX 32
+// Size of buffer for spec_build
+#define SPEC_BUF_SIZE (SPEC_MAX + 2 * 12)
+
+struct spec {
+	size_t len; // length of specification including %
+	bool width_arg; // width is passed as argument
+	bool precision_arg; // precision is passed as argument
+	int precision; // precision specified in format or -1
+	enum arg_type type;
+	bool is_unsigned; // unsigned integer conversion
+	unsigned char length_pos, length_len; // length modifier in specification
+};
+
+// Parse printf conversion specification starting with %. Returns false if it is
+// not supported (%n, %m, positional arguments and wide strings).
+bool parse_spec(const char *str, struct spec *spec) __attribute__((nonnull));
+
+// Build specification to buf (of SPEC_BUF_SIZE) with widths and precisions passed
+// as arguments replaced by given values. Length modifier is replaced with given
+// one unless it is NULL.
+void spec_build(char *buf, const char *str, const struct spec *spec, int width,
+		int precision, const char *length) __attribute__((nonnull(1, 2, 3)));
+
+#endif
@@ -1,20 +1,33 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // Copyright 2020, CZ.NIC z.s.p.o. (http://www.nic.cz/)
 #include "log.h"
+#include "config.h"
 
 bool log_syslog(log_t log) {
-	if (!log->_log)
-		return log->daemon;
-	return (!log->_log->no_syslog && log->daemon) || log->_log->syslog_format;
+	config_read_lock();
+	bool res = config_syslog(log, log_config(log));
+	config_read_unlock();
+	return res;
 }
 
 void log_syslog_format(log_t log, const char *format) {
-	log_allocate(log);
-	free_format(log->_log->syslog_format);
-	log->_log->syslog_format = format ? parse_format(format) : NULL;
+	struct format_set *set = NULL;
+	if (format) {
+		struct format *fformat = parse_format(format);
+		set = malloc(sizeof *set);
+		format_set_init(set, fformat, false, false);
+		free_format(fformat);
+	}
+	struct log_config *config = config_edit(log);
+	struct format_set *old = config->syslog_format;
+	config->syslog_format = set;
+	config_commit(log, config);
+	format_set_free(old);
+	free(old);
 }
 
 void log_syslog_fallback(log_t log, bool enabled) {
-	log_allocate(log);
-	log->_log->no_syslog = !enabled;
+	struct log_config *config = config_edit(log);
+	config->no_syslog = !enabled;
+	config_commit(log, config);
 }
@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "timestamp.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define HAVE_TSC
+#endif
+
+#define NS 1000000000L
+
+static enum log_clock clock_source = LOG_CLOCK_REALTIME;
+
+// Monotonic time the library was loaded at (start of the elapsed time)
+static struct timespec start;
+
+__attribute__((constructor))
+static void constructor() {
+	clock_gettime(CLOCK_MONOTONIC, &start);
+}
+
+static int64_t ts2ns(const struct timespec *ts) {
+	return (int64_t)ts->tv_sec * NS + ts->tv_nsec;
+}
+
+static void ns2ts(int64_t ns, struct timespec *ts) {
+	ts->tv_sec = ns / NS;
+	ts->tv_nsec = ns % NS;
+}
+
+
+#ifdef HAVE_TSC
+// TSC is converted to time relative to the base sampled together with both
+// clocks. The base is periodically resampled and conversion coefficient is
+// refined from the difference between bases. Readers use the base published last.
+struct tsc_base {
+	uint64_t tsc;
+	struct timespec real, mono;
+	double ns_per_tick;
+};
+static struct tsc_base tsc_bases[2];
+static struct tsc_base *tsc_base = NULL;
+static bool tsc_resyncing = false;
+
+#define TSC_CALIBRATION_NS 10000000L
+#define TSC_RESYNC_NS (60 * NS)
+
+static void tsc_sample(struct tsc_base *base) {
+	clock_gettime(CLOCK_MONOTONIC, &base->mono);
+	base->tsc = __rdtsc();
+	clock_gettime(CLOCK_REALTIME, &base->real);
+}
+
+// The next base is written to the one not published
+static struct tsc_base *tsc_next_base(const struct tsc_base *current) {
+	return current == &tsc_bases[0] ? &tsc_bases[1] : &tsc_bases[0];
+}
+
+static bool tsc_calibrate() {
+	// Only invariant TSC runs with constant rate in all power states
+	unsigned eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+		return false;
+	struct tsc_base first;
+	struct tsc_base *base = tsc_next_base(__atomic_load_n(&tsc_base, __ATOMIC_ACQUIRE));
+	tsc_sample(&first);
+	nanosleep(&(struct timespec){.tv_nsec = TSC_CALIBRATION_NS}, NULL);
+	tsc_sample(base);
+	if (base->tsc <= first.tsc)
+		return false;
+	base->ns_per_tick =
+		(double)(ts2ns(&base->mono) - ts2ns(&first.mono)) / (base->tsc - first.tsc);
+	__atomic_store_n(&tsc_base, base, __ATOMIC_RELEASE);
+	return true;
+}
+
+static void tsc_resync(const struct tsc_base *current) {
+	bool expected = false;
+	if (!__atomic_compare_exchange_n(&tsc_resyncing, &expected, true, false,
+				__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return; // Some other thread is already on it
+	struct tsc_base *base = tsc_next_base(current);
+	tsc_sample(base);
+	base->ns_per_tick = (double)(ts2ns(&base->mono) - ts2ns(&current->mono)) /
+		(base->tsc - current->tsc);
+	__atomic_store_n(&tsc_base, base, __ATOMIC_RELEASE);
+	__atomic_store_n(&tsc_resyncing, false, __ATOMIC_RELEASE);
+}
+
+static void tsc_read(struct timespec *real, struct timespec *mono) {
+	const struct tsc_base *base = __atomic_load_n(&tsc_base, __ATOMIC_ACQUIRE);
+	int64_t delta = (int64_t)((__rdtsc() - base->tsc) * base->ns_per_tick);
+	ns2ts(ts2ns(&base->real) + delta, real);
+	ns2ts(ts2ns(&base->mono) + delta, mono);
+	if (delta > TSC_RESYNC_NS)
+		tsc_resync(base);
+}
+#endif
+
+enum log_clock log_clock() {
+	return __atomic_load_n(&clock_source, __ATOMIC_RELAXED);
+}
+
+bool log_set_clock(enum log_clock clock) {
+	if (clock == LOG_CLOCK_TSC) {
+#ifdef HAVE_TSC
+		if (!tsc_calibrate())
+			return false;
+#else
+		return false;
+#endif
+	}
+	__atomic_store_n(&clock_source, clock, __ATOMIC_RELAXED);
+	return true;
+}
+
+bool log_time_read(struct log_time *time, unsigned clocks) {
+	unsigned missing = clocks & ~time->have;
+	if (missing && !time->frozen) {
+		struct timespec real, mono;
+		switch (__atomic_load_n(&clock_source, __ATOMIC_RELAXED)) {
+			case LOG_CLOCK_REALTIME_COARSE:
+				if (missing & LT_REAL)
+					clock_gettime(CLOCK_REALTIME_COARSE, &real);
+				if (missing & LT_MONO)
+					clock_gettime(CLOCK_MONOTONIC_COARSE, &mono);
+				break;
+#ifdef HAVE_TSC
+			case LOG_CLOCK_TSC:
+				tsc_read(&real, &mono);
+				break;
+#endif
+			default:
+				if (missing & LT_REAL)
+					clock_gettime(CLOCK_REALTIME, &real);
+				if (missing & LT_MONO)
+					clock_gettime(CLOCK_MONOTONIC, &mono);
+				break;
+		}
+		if (missing & LT_REAL)
+			time->real = real;
+		if (missing & LT_MONO)
+			time->mono = mono;
+		time->have |= missing;
+	}
+	return (time->have & clocks) == clocks;
+}
+
+
+// Date and time are rendered only once per second in every thread. The busy flag
+// protects cache from signal handler that would interrupt its update.
+struct second_cache {
+	time_t sec;
+	volatile sig_atomic_t busy;
+	char date[32];
+	size_t date_len;
+	char zone[8];
+};
+static __thread struct second_cache local_cache = {.sec = -1};
+static __thread struct second_cache utc_cache = {.sec = -1};
+
+static const struct second_cache *second_cache(struct second_cache *cache,
+		struct second_cache *tmp, time_t sec, bool utc) {
+	if (cache->sec == sec && !cache->busy)
+		return cache;
+	struct second_cache *c = cache;
+	if (cache->busy)
+		c = tmp; // We interrupted update of the cache so we can't use it
+	else {
+		cache->busy = true;
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	}
+
+	struct tm tm;
+	if (utc)
+		gmtime_r(&sec, &tm);
+	else
+		localtime_r(&sec, &tm);
+	c->date_len = strftime(c->date, sizeof c->date, "%Y-%m-%dT%H:%M:%S", &tm);
+	long offset = utc ? 0 : tm.tm_gmtoff;
+	long abs_offset = labs(offset) / 60;
+	snprintf(c->zone, sizeof c->zone, "%c%02ld:%02ld", offset < 0 ? '-' : '+',
+			abs_offset / 60 % 100, abs_offset % 60);
+	c->sec = sec;
+
+	if (c == cache) {
+		__atomic_signal_fence(__ATOMIC_SEQ_CST);
+		cache->busy = false;
+	}
+	return c;
+}
+
+static void render_uint(struct record *r, uint64_t value) {
+	char buf[20];
+	size_t i = sizeof buf;
+	do {
+		buf[--i] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	record_append(r, buf + i, sizeof buf - i);
+}
+
+static void render_fraction(struct record *r, long nsec, size_t digits) {
+	char buf[10];
+	buf[0] = '.';
+	for (size_t i = 9; i > digits; i--)
+		nsec /= 10;
+	for (size_t i = digits; i > 0; i--) {
+		buf[i] = '0' + nsec % 10;
+		nsec /= 10;
+	}
+	record_append(r, buf, digits + 1);
+}
+
+void render_time(struct record *r, const struct format_op *op,
+		struct log_time *time, const struct timespec **last) {
+	struct second_cache tmp;
+	const struct second_cache *cache;
+	switch (op->type) {
+		case FF_TIME_ISO:
+		case FF_TIME_ZONE:
+		case FF_TIME_RFC3339:
+			if (!log_time_read(time, LT_REAL))
+				return;
+			cache = second_cache(&local_cache, &tmp, time->real.tv_sec, false);
+			if (op->type != FF_TIME_ZONE)
+				record_append(r, cache->date, cache->date_len);
+			if (op->type == FF_TIME_RFC3339)
+				render_fraction(r, time->real.tv_nsec, 6);
+			if (op->type != FF_TIME_ISO)
+				record_puts(r, cache->zone);
+			*last = &time->real;
+			break;
+		case FF_TIME_UTC:
+			if (!log_time_read(time, LT_REAL))
+				return;
+			cache = second_cache(&utc_cache, &tmp, time->real.tv_sec, true);
+			record_append(r, cache->date, cache->date_len);
+			*last = &time->real;
+			break;
+		case FF_TIME_EPOCH:
+			if (!log_time_read(time, LT_REAL))
+				return;
+			render_uint(r, time->real.tv_sec);
+			*last = &time->real;
+			break;
+		case FF_TIME_MONO:
+			if (!log_time_read(time, LT_MONO))
+				return;
+			render_uint(r, time->mono.tv_sec);
+			*last = &time->mono;
+			break;
+		case FF_TIME_ELAPSED:
+			if (!log_time_read(time, LT_MONO))
+				return;
+			int64_t elapsed = ts2ns(&time->mono) - ts2ns(&start);
+			ns2ts(elapsed > 0 ? elapsed : 0, &time->elapsed);
+			render_uint(r, time->elapsed.tv_sec);
+			*last = &time->elapsed;
+			break;
+		case FF_TIME_FRAC:
+			if (*last == NULL) {
+				if (!log_time_read(time, LT_REAL))
+					return;
+				*last = &time->real;
+			}
+			render_fraction(r, (*last)->tv_nsec, op->len);
+			break;
+		default:
+			break;
+	}
+}
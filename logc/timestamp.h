@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_TIMESTAMP_H_
+#define _LOGC_TIMESTAMP_H_
+#include <logc.h>
+#include <time.h>
+#include "format.h"
+#include "record.h"
+
+#define LT_REAL (1 << 0) // wall clock time
+#define LT_MONO (1 << 1) // monotonic time
+
+// Time of the message. Clocks are read lazily once the first output needs them so
+// all outputs receive the same time.
+struct log_time {
+	unsigned have; // LT_* of clocks already read
+	bool frozen; // clocks are not read anymore (missing ones are empty)
+	struct timespec real;
+	struct timespec mono;
+	struct timespec elapsed; // computed from mono when rendered
+};
+
+// Read given clocks (LT_*) unless they were already read or time is frozen.
+// Returns true if all of them are available.
+bool log_time_read(struct log_time *time, unsigned clocks) __attribute__((nonnull));
+
+// Render time field (FF_TIME_*) to record. The last is the time used by previous
+// time field in the line (the fraction refers to it) or NULL if there was none.
+void render_time(struct record *r, const struct format_op *op,
+		struct log_time *time, const struct timespec **last) __attribute__((nonnull));
+
+#endif
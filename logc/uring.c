@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include "uring.h"
+#include "record.h"
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef LOGC_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#ifdef LOGC_IO_URING
+
+// Batch is submitted once it is larger than this even if there are more lines
+#define BATCH_SIZE (64 * 1024)
+// Only single write is in flight at a time so lines are written in order
+#define RING_ENTRIES 2
+
+struct uring {
+	int fd;
+	int ring;
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct record records[2];
+	struct record *batch; // lines collected for the next write
+	size_t batch_lines;
+	struct record *flight; // lines being written
+	size_t flight_lines;
+	size_t flight_written;
+	bool in_flight;
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int ring, unsigned to_submit, unsigned min_complete) {
+	return syscall(__NR_io_uring_enter, ring, to_submit, min_complete,
+			min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+static bool map_rings(struct uring *u, const struct io_uring_params *p) {
+	u->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+	u->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	if (p->features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_ring_size > u->sq_ring_size)
+			u->sq_ring_size = u->cq_ring_size;
+		u->cq_ring_size = 0;
+	}
+	u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->ring, IORING_OFF_SQ_RING);
+	if (u->sq_ring == MAP_FAILED)
+		return false;
+	u->cq_ring = u->sq_ring;
+	if (u->cq_ring_size) {
+		u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, u->ring, IORING_OFF_CQ_RING);
+		if (u->cq_ring == MAP_FAILED) {
+			munmap(u->sq_ring, u->sq_ring_size);
+			return false;
+		}
+	}
+	u->sqes = mmap(NULL, p->sq_entries * sizeof(struct io_uring_sqe),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->ring, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		munmap(u->sq_ring, u->sq_ring_size);
+		if (u->cq_ring_size)
+			munmap(u->cq_ring, u->cq_ring_size);
+		return false;
+	}
+	u->sq_tail = u->sq_ring + p->sq_off.tail;
+	u->sq_mask = u->sq_ring + p->sq_off.ring_mask;
+	u->sq_array = u->sq_ring + p->sq_off.array;
+	u->cq_head = u->cq_ring + p->cq_off.head;
+	u->cq_tail = u->cq_ring + p->cq_off.tail;
+	u->cq_mask = u->cq_ring + p->cq_off.ring_mask;
+	u->cqes = u->cq_ring + p->cq_off.cqes;
+	return true;
+}
+
+struct uring *uring_new(int fd) {
+	if (fd == -1)
+		return NULL;
+	struct io_uring_params p = {0};
+	int ring = uring_setup(RING_ENTRIES, &p);
+	if (ring == -1) {
+		errno = 0; // io_uring is not available
+		return NULL;
+	}
+	struct uring *u = malloc(sizeof *u);
+	*u = (struct uring){.fd = fd, .ring = ring};
+	// Writes have to use current file position as with plain write
+	if (!(p.features & IORING_FEAT_RW_CUR_POS) || !map_rings(u, &p)) {
+		close(ring);
+		free(u);
+		errno = 0;
+		return NULL;
+	}
+	record_init(&u->records[0]);
+	record_init(&u->records[1]);
+	u->batch = &u->records[0];
+	u->flight = &u->records[1];
+	return u;
+}
+
+// Submit (the rest of) flight and optionally wait for its completion
+static void submit_flight(struct uring *u, bool wait) {
+	unsigned tail = *u->sq_tail;
+	unsigned index = tail & *u->sq_mask;
+	u->sqes[index] = (struct io_uring_sqe){
+		.opcode = IORING_OP_WRITE,
+		.fd = u->fd,
+		.off = (__u64)-1, // current file position as with plain write
+		.addr = (__u64)(uintptr_t)(u->flight->data + u->flight_written),
+		.len = u->flight->len - u->flight_written,
+	};
+	u->sq_array[index] = index;
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	while (uring_enter(u->ring, 1, wait) == -1 && errno == EINTR);
+	u->in_flight = true;
+}
+
+// Finish write in flight. Returns number of its lines or zero if it is still in
+// flight and we should not wait for it.
+static size_t finish(struct uring *u, bool wait) {
+	while (u->in_flight) {
+		unsigned head = *u->cq_head;
+		if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			if (!wait)
+				return 0;
+			while (uring_enter(u->ring, 0, 1) == -1 && errno == EINTR);
+			continue;
+		}
+		int res = u->cqes[head & *u->cq_mask].res;
+		__atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+		if (res > 0)
+			u->flight_written += res;
+		// Lines are dropped on error as there is nothing we can do about it
+		if ((res > 0 || res == -EINTR || res == -EAGAIN) &&
+				u->flight_written < u->flight->len)
+			submit_flight(u, wait);
+		else
+			u->in_flight = false;
+	}
+	size_t lines = u->flight_lines;
+	u->flight_lines = 0;
+	return lines;
+}
+
+// Submit collected batch. There must be no write in flight.
+static void submit(struct uring *u, bool wait) {
+	struct record *tmp = u->flight;
+	u->flight = u->batch;
+	u->batch = tmp;
+	u->batch->len = 0;
+	u->flight_lines = u->batch_lines;
+	u->batch_lines = 0;
+	u->flight_written = 0;
+	if (u->flight->len)
+		submit_flight(u, wait);
+}
+
+size_t uring_write(struct uring *u, const char *data, size_t len) {
+	record_append(u->batch, data, len);
+	u->batch_lines++;
+	if (u->batch->len < BATCH_SIZE)
+		return finish(u, false);
+	size_t completed = finish(u, true);
+	submit(u, false);
+	return completed;
+}
+
+size_t uring_wait(struct uring *u) {
+	size_t completed = finish(u, true);
+	submit(u, true);
+	return completed + finish(u, true);
+}
+
+void uring_free(struct uring *u) {
+	if (u == NULL)
+		return;
+	uring_wait(u);
+	munmap(u->sqes, RING_ENTRIES * sizeof(struct io_uring_sqe));
+	munmap(u->sq_ring, u->sq_ring_size);
+	if (u->cq_ring_size)
+		munmap(u->cq_ring, u->cq_ring_size);
+	close(u->ring);
+	record_free(&u->records[0]);
+	record_free(&u->records[1]);
+	free(u);
+}
+
+#else
+
+struct uring *uring_new(int fd) {
+	return NULL;
+}
+
+void uring_free(struct uring *u) {}
+
+size_t uring_write(struct uring *u, const char *data, size_t len) {
+	return 0;
+}
+
+size_t uring_wait(struct uring *u) {
+	return 0;
+}
+
+#endif
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#ifndef _LOGC_URING_H_
+#define _LOGC_URING_H_
+#include <stddef.h>
+
+// io_uring backend of asynchronous output (LOG_F_IO_URING). It is used only by
+// writer thread. Lines are collected to batch that is submitted as a single write
+// while the previous batch is being written. All functions return number of lines
+// that were written (or failed) since the last call so writer can report progress.
+struct uring;
+
+// Setup io_uring for given file descriptor. Returns NULL if io_uring is not
+// available and thus plain write has to be used.
+struct uring *uring_new(int fd);
+// Wait for all lines to be written and release io_uring.
+void uring_free(struct uring *u);
+
+// Add line to the batch. Batch is submitted once it is large enough.
+size_t uring_write(struct uring *u, const char *data, size_t len)
+	__attribute__((nonnull));
+
+// Submit the batch and wait for it to be written
+size_t uring_wait(struct uring *u) __attribute__((nonnull));
+
+#endif
@@ -57,13 +57,10 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
 		case 'q':
 			log_quiet(logc_argp_log);
 			break;
-		case ARGPO_LOG_FILE: {
-			FILE *file = fopen(arg, "a");
-			if (file == NULL)
+		case ARGPO_LOG_FILE:
+			if (!log_add_file_output(logc_argp_log, arg, 0, 0, LOG_FORMAT_DEFAULT, NULL))
 				argp_error(state, "Unable to open file '%s' for writing: %s", arg, strerror(errno));
-			else
-				log_add_output(logc_argp_log, file, LOG_F_AUTOCLOSE, 0, LOG_FORMAT_DEFAULT);
-			break; }
+			break;
 		case ARGPO_SYSLOG:
 			log_syslog_format(logc_argp_log, LOG_FORMAT_DEFAULT);
 			// Intentional fall trough
@@ -3,6 +3,8 @@
 #include <signal.h>
 #include <errno.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 #define SUITE "logc"
 #include "unittests.h"
@@ -128,6 +130,44 @@ TEST(def_output, disabled_def_output) {
 }
 END_TEST
 
+TEST(def_output, disabled_not_evaluated) {
+	int cnt = 0;
+	debug("Debug %d", cnt++);
+	log_quiet(tlog);
+	notice("Notice %d", cnt++);
+	ck_assert_int_eq(cnt, 0);
+	warning("Warning %d", cnt++);
+	ck_assert_int_eq(cnt, 1);
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "WARNING:tlog: Warning 0\n");
+}
+END_TEST
+
+TEST(def_output, long_message) {
+	char *buf1, *buf2;
+	size_t bufsiz1, bufsiz2;
+	FILE *f1 = open_memstream(&buf1, &bufsiz1);
+	FILE *f2 = open_memstream(&buf2, &bufsiz2);
+	log_add_output(tlog, f1, LOG_F_AUTOCLOSE, 0, LOG_FORMAT_PLAIN);
+	log_add_output(tlog, f2, LOG_F_AUTOCLOSE, 0, "%m");
+
+	char msg[4096];
+	memset(msg, 'x', sizeof msg - 1);
+	msg[sizeof msg - 1] = '\0';
+	notice("%s", msg);
+	notice("%.10s", msg);
+	log_wipe_outputs(tlog);
+
+	ck_assert_int_eq(bufsiz1, 2 * strlen("tlog: \n") + sizeof msg - 1 + 10);
+	ck_assert_int_eq(bufsiz2, 2 * strlen("\n") + sizeof msg - 1 + 10);
+	ck_assert_mem_eq(buf2, msg, sizeof msg - 1);
+	ck_assert_str_eq(buf2 + sizeof msg - 1, "\nxxxxxxxxxx\n");
+	free(buf1);
+	free(buf2);
+}
+END_TEST
+
 TEST(def_output, message_origin) {
 	ck_assert(!log_use_origin(tlog));
 	log_set_use_origin(tlog, true);
@@ -156,6 +196,21 @@ LOOP_TEST(would_log, check_would_log, LL_TRACE, LL_CRITICAL) {
 }
 END_TEST
 
+// Logs that were never configured share cached threshold that has to be left
+// once log is configured
+TEST(would_log, unconfigured_would_log) {
+	struct log other = {.name = "other"};
+	ck_assert(!log_would_log(tlog, LL_INFO));
+	ck_assert(!log_would_log(&other, LL_INFO));
+	ck_assert(log_would_log(&other, LL_NOTICE));
+	log_set_level(tlog, LL_INFO);
+	ck_assert(log_would_log(tlog, LL_INFO));
+	ck_assert(!log_would_log(&other, LL_INFO));
+	info("Info");
+	ck_assert_str_eq(stderr_data, "INFO:tlog: Info\n");
+}
+END_TEST
+
 
 TEST_CASE(custom_format) {}
 
@@ -186,6 +241,16 @@ static const struct {
 	{"%(Dtext%)", "text"},
 	{"%(c%(e%(wtext%)%)%)", "text"},
 	{"%(c%(e%(wtext", "text"}, // Verify that unterminated ifs are not an issue
+	{"%(Ctext%|else%)", "else"},
+	{"%(ctext%|else%)", "text"},
+	{"%(_%e%|else%)", "else"},
+	{"%(_x%(Ctext%)%|else%)", "else"}, // Unfulfilled condition is empty
+	{"%(_x%(ctext%)%|else%)", "xtext"},
+	{"%(_x%(Ctext%|y%)%|else%)", "xy"}, // Condition with else is never empty
+	{"%(N%(Ctext%|else%)after%)", "elseafter"},
+	{"before%(Ctext%)after", "beforeafter"},
+	{"%(_%(_%(ctext%)%)x%)", "textx"}, // Fulfilled nested condition is non-empty
+	{"a%|b%)c", "abc"}, // Else and end outside of condition are ignored
 	// Note: Output is to memstream not to terminal
 	{"%(ttext%)", "text"},
 	{"%(Ttext%)", ""},
@@ -312,6 +377,74 @@ TEST(custom_format, check_custom_output_wipe) {
 }
 END_TEST
 
+static const int lock_flags[] = {
+	0,
+	LOG_F_LOCK_NONE,
+	LOG_F_LOCK_MUTEX,
+	LOG_F_LOCK_APPEND,
+	LOG_F_LOCK_FLOCK,
+	LOG_F_LOCK_FCNTL,
+	LOG_F_LOCK_NONE | LOG_F_LOCK_FCNTL,
+};
+
+ARRAY_TEST(custom_format, check_file_output_lock, lock_flags) {
+	FILE *f = tmpfile();
+
+	log_add_output(tlog, f, _d, 0, LOG_FORMAT_PLAIN);
+	notice("Message");
+	notice("Second");
+	log_wipe_outputs(tlog);
+
+	char *line = NULL;
+	size_t line_size = 0;
+	rewind(f);
+	ck_assert_int_ge(getline(&line, &line_size, f), 0);
+	ck_assert_str_eq(line, "tlog: Message\n");
+	ck_assert_int_ge(getline(&line, &line_size, f), 0);
+	ck_assert_str_eq(line, "tlog: Second\n");
+	ck_assert_int_eq(getline(&line, &line_size, f), -1);
+
+	free(line);
+	fclose(f);
+}
+END_TEST
+
+// Lines written from multiple processes to the same file have to never be
+// interleaved.
+TEST(custom_format, check_file_output_forks) {
+	char path[] = "/tmp/logc-test-XXXXXX";
+	close(mkstemp(path));
+	FILE *f = fopen(path, "a");
+	log_add_output(tlog, f, LOG_F_AUTOCLOSE, 0, "%m");
+
+	char msg[2048];
+	memset(msg, 'x', sizeof msg - 1);
+	msg[sizeof msg - 1] = '\0';
+	const int forks = 4, lines = 100;
+	for (int i = 0; i < forks; i++)
+		if (fork() == 0) {
+			for (int y = 0; y < lines; y++)
+				notice("%s", msg);
+			_exit(0);
+		}
+	for (int i = 0; i < forks; i++)
+		wait(NULL);
+	log_wipe_outputs(tlog);
+
+	f = fopen(path, "r");
+	char *line = NULL;
+	size_t line_size = 0;
+	for (int i = 0; i < forks * lines; i++) {
+		ck_assert_int_eq(getline(&line, &line_size, f), sizeof msg);
+		ck_assert_mem_eq(line, msg, sizeof msg - 1);
+	}
+	ck_assert_int_eq(getline(&line, &line_size, f), -1);
+	free(line);
+	fclose(f);
+	unlink(path);
+}
+END_TEST
+
 // We test here once with real file as memstream does not have fileno while real
 // tmpfile does.
 TEST(custom_format, check_custom_file_output) {
@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <pthread.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define SUITE "async"
+#include "unittests.h"
+
+// Size of the queue of asynchronous output in the library
+#define QUEUE_SIZE 1024
+
+TEST_CASE(async) {}
+
+// io_uring is used only if it is available but lines have to be written anyway
+static const int file_flags[] = {
+	LOG_F_ASYNC,
+	LOG_F_ASYNC_DEFERRED,
+	LOG_F_IO_URING,
+	LOG_F_IO_URING | LOG_F_ASYNC_DEFERRED,
+};
+
+ARRAY_TEST(async, async_file, file_flags) {
+	FILE *f = tmpfile();
+	log_add_output(tlog, f, _d, 0, "%m");
+
+	const int lines = 5 * QUEUE_SIZE;
+	for (int i = 0; i < lines; i++)
+		notice("%d", i);
+	log_flush(tlog);
+
+	int num;
+	rewind(f);
+	for (int i = 0; i < lines; i++) {
+		ck_assert_int_eq(fscanf(f, "%d\n", &num), 1);
+		ck_assert_int_eq(num, i);
+	}
+	ck_assert_int_eq(fscanf(f, "%d\n", &num), EOF);
+	ck_assert_int_eq(log_output_dropped(tlog, f), 0);
+
+	log_rm_output(tlog, f);
+	fclose(f);
+}
+END_TEST
+
+// Short lines are stored in the queue and long ones are allocated
+ARRAY_TEST(async, async_line_sizes, file_flags) {
+	FILE *f = tmpfile();
+	log_add_output(tlog, f, _d, 0, "%m");
+
+	char payload[600];
+	memset(payload, 'x', sizeof payload);
+	const int lines = 2 * QUEUE_SIZE;
+	for (int i = 0; i < lines; i++)
+		notice("%.*s", i % (int)sizeof payload, payload);
+	log_flush(tlog);
+
+	char *line = NULL;
+	size_t line_size = 0;
+	rewind(f);
+	for (int i = 0; i < lines; i++) {
+		ck_assert_int_eq(getline(&line, &line_size, f), i % sizeof payload + 1);
+		ck_assert_uint_eq(strspn(line, "x"), i % sizeof payload);
+	}
+	ck_assert_int_eq(getline(&line, &line_size, f), -1);
+	free(line);
+
+	log_rm_output(tlog, f);
+	fclose(f);
+}
+END_TEST
+
+// Output that blocks until gate is unlocked
+static pthread_mutex_t gate = PTHREAD_MUTEX_INITIALIZER;
+
+static ssize_t gated_write(void *cookie, const char *buf, size_t size) {
+	pthread_mutex_lock(&gate);
+	pthread_mutex_unlock(&gate);
+	return fwrite(buf, 1, size, cookie);
+}
+
+static FILE *gated_output(FILE *f) {
+	FILE *res = fopencookie(f, "w", (cookie_io_functions_t){.write = gated_write});
+	setvbuf(res, NULL, _IONBF, 0);
+	return res;
+}
+
+static const struct {
+	int flag;
+	bool oldest;
+} drop_policies[] = {
+	{LOG_F_ASYNC_DROP_NEWEST, false},
+	{LOG_F_ASYNC_DROP_OLDEST, true},
+};
+
+ARRAY_TEST(async, async_drop, drop_policies) {
+	char *buf;
+	size_t bufsiz;
+	FILE *mem = open_memstream(&buf, &bufsiz);
+	FILE *f = gated_output(mem);
+	log_add_output(tlog, f, _d.flag, 0, "%m");
+
+	const int lines = 3 * QUEUE_SIZE;
+	pthread_mutex_lock(&gate);
+	for (int i = 0; i < lines; i++)
+		notice("%d", i);
+	pthread_mutex_unlock(&gate);
+	log_flush(tlog);
+	size_t dropped = log_output_dropped(tlog, f);
+	log_rm_output(tlog, f);
+	fclose(f);
+	fclose(mem);
+
+	ck_assert_uint_ge(dropped, lines - QUEUE_SIZE - 1);
+	FILE *res = fmemopen(buf, bufsiz, "r");
+	int num, prev = -1, cnt = 0, first = 0;
+	while (fscanf(res, "%d\n", &num) == 1) {
+		ck_assert_int_gt(num, prev);
+		if (num == cnt)
+			first++;
+		prev = num;
+		cnt++;
+	}
+	fclose(res);
+	ck_assert_int_eq(cnt + dropped, lines);
+	if (_d.oldest)
+		ck_assert_int_eq(prev, lines - 1); // The newest line is always written
+	else
+		// The first lines are written (writer can take one line from queue and thus
+		// free space for one later line)
+		ck_assert_int_ge(first, QUEUE_SIZE);
+	free(buf);
+}
+END_TEST
+
+// Nothing is dropped with blocking policy, logging just waits for the writer
+TEST(async, async_block) {
+	char *buf;
+	size_t bufsiz;
+	FILE *mem = open_memstream(&buf, &bufsiz);
+	FILE *f = gated_output(mem);
+	log_add_output(tlog, f, LOG_F_ASYNC, 0, "%m");
+
+	pthread_mutex_lock(&gate);
+	for (int i = 0; i < QUEUE_SIZE / 2; i++)
+		notice("%d", i);
+	ck_assert_uint_eq(bufsiz, 0);
+	pthread_mutex_unlock(&gate);
+	for (int i = QUEUE_SIZE / 2; i < 2 * QUEUE_SIZE; i++)
+		notice("%d", i);
+	log_rm_output(tlog, f);
+	fclose(f);
+	fclose(mem);
+
+	FILE *res = fmemopen(buf, bufsiz, "r");
+	int num;
+	for (int i = 0; i < 2 * QUEUE_SIZE; i++) {
+		ck_assert_int_eq(fscanf(res, "%d\n", &num), 1);
+		ck_assert_int_eq(num, i);
+	}
+	fclose(res);
+	free(buf);
+}
+END_TEST
+
+// Deferred formatting has to produce the same lines as immediate formatting
+TEST(async, async_deferred) {
+	static const char *const format = "%n%(: %m%)%(: %e%)";
+	FILE *direct = tmpfile();
+	FILE *deferred = tmpfile();
+	log_add_output(tlog, direct, 0, 0, format);
+	log_add_output(tlog, deferred, LOG_F_ASYNC_DEFERRED, 0, format);
+
+	char str[] = "volatile";
+	char unterminated[] = {'a', 'b', 'c'};
+	const char *volatile null = NULL;
+	notice("conn %d from %s", 42, str);
+	strcpy(str, "changed!");
+	notice("%-5d|%+.3i|%05u|%hhx|%hd|%lx|%lld|%jd|%zu|%td", -1, 7, 3u, 0x1ff, -2,
+			123456789l, -1ll, (intmax_t)9, (size_t)8, (ptrdiff_t)-3);
+	notice("%.2f|%e|%G|%a|%10.3Lf", 3.14159, 1e10, 0.0001, 1.0, 2.5L);
+	notice("%*d|%-*d|%.*d|%.*s|%*.*s|%.3s|%c|%%", 4, 1, 4, 2, -1, 3, 2, "text", 6, 2,
+			"text", unterminated, 'x');
+	notice("%s|%p|%5s|%.1s", null, (void *)0x1234, "ab", "");
+	notice("%s", "");
+	errno = ENOENT;
+	error("%m and %n", (int[]){0}); // can't be deferred
+	errno = EACCES;
+	error("failed %s", "open");
+	log_flush(tlog);
+	log_rm_output(tlog, direct);
+	log_rm_output(tlog, deferred);
+
+	rewind(direct);
+	rewind(deferred);
+	char *line = NULL, *expected = NULL;
+	size_t size = 0, expected_size = 0;
+	int lines = 0;
+	while (getline(&expected, &expected_size, direct) != -1) {
+		ck_assert_int_ne(getline(&line, &size, deferred), -1);
+		ck_assert_str_eq(line, expected);
+		lines++;
+	}
+	ck_assert_int_eq(getline(&line, &size, deferred), -1);
+	ck_assert_int_eq(lines, 8);
+	free(line);
+	free(expected);
+	fclose(direct);
+	fclose(deferred);
+}
+END_TEST
+
+// Forked process writes lines directly and has to be able to free the output even
+// if writer thread of parent was waiting at the time of fork
+TEST(async, async_fork) {
+	FILE *f = tmpfile();
+	log_add_output(tlog, f, LOG_F_ASYNC, 0, "%m");
+	notice("parent");
+	log_flush(tlog);
+	usleep(10000); // let writer go to sleep
+
+	pid_t pid = fork();
+	ck_assert_int_ne(pid, -1);
+	if (pid == 0) {
+		notice("child");
+		log_free(tlog);
+		exit(0);
+	}
+	int status;
+	ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+	ck_assert_int_eq(status, 0);
+
+	char buf[BUFSIZ];
+	ck_assert_int_eq(pread(fileno(f), buf, sizeof buf, 0), 13);
+	ck_assert_mem_eq(buf, "parent\nchild\n", 13);
+	log_rm_output(tlog, f);
+	fclose(f);
+}
+END_TEST
+
+// Queued lines are written on exit even without log_flush
+ARRAY_TEST(async, async_exit, file_flags) {
+	FILE *f = tmpfile();
+	const int lines = 2 * QUEUE_SIZE;
+
+	pid_t pid = fork();
+	ck_assert_int_ne(pid, -1);
+	if (pid == 0) {
+		log_add_output(tlog, f, _d | LOG_F_BUFFER, 0, "%m");
+		for (int i = 0; i < lines; i++)
+			notice("%d", i);
+		exit(0);
+	}
+	int status;
+	ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+	ck_assert_int_eq(status, 0);
+
+	int num;
+	rewind(f);
+	for (int i = 0; i < lines; i++) {
+		ck_assert_int_eq(fscanf(f, "%d\n", &num), 1);
+		ck_assert_int_eq(num, i);
+	}
+	ck_assert_int_eq(fscanf(f, "%d\n", &num), EOF);
+	fclose(f);
+}
+END_TEST
@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define SUITE "binary"
+#include "unittests.h"
+
+TEST_CASE(binary) {}
+
+// Decode binary log at given path with logc-decode (path to it is provided by
+// LOGC_DECODE environment variable) and return its output.
+static char *decode(const char *path, const char *format) {
+	const char *decoder = getenv("LOGC_DECODE");
+	ck_assert_ptr_nonnull(decoder);
+	char *cmd;
+	ck_assert_int_ne(asprintf(&cmd, "'%s' -f '%s' '%s'", decoder, format, path), -1);
+	FILE *p = popen(cmd, "r");
+	free(cmd);
+	ck_assert_ptr_nonnull(p);
+	char *res;
+	size_t size;
+	FILE *mem = open_memstream(&res, &size);
+	char buf[BUFSIZ];
+	size_t len;
+	while ((len = fread(buf, 1, sizeof buf, p)))
+		fwrite(buf, 1, len, mem);
+	fclose(mem);
+	ck_assert_int_eq(pclose(p), 0);
+	return res;
+}
+
+static char *file_content(FILE *f) {
+	rewind(f);
+	char *res;
+	size_t size;
+	FILE *mem = open_memstream(&res, &size);
+	char buf[BUFSIZ];
+	size_t len;
+	while ((len = fread(buf, 1, sizeof buf, f)))
+		fwrite(buf, 1, len, mem);
+	fclose(mem);
+	return res;
+}
+
+static FILE *binary_file(char *path) {
+	int fd = mkstemp(path);
+	ck_assert_int_ne(fd, -1);
+	return fdopen(fd, "w+");
+}
+
+// Decoded output has to be the same as text output with the same format
+TEST(binary, binary_decode) {
+	char path[] = "/tmp/logc-binary-XXXXXX";
+	FILE *bin = binary_file(path);
+	FILE *text = tmpfile();
+	log_set_use_origin(tlog, true);
+	log_add_binary_output(tlog, bin, 0, 0);
+	log_add_output(tlog, text, 0, 0, LOG_FORMAT_FULL);
+
+	char unterminated[] = {'a', 'b', 'c'};
+	const char *volatile null = NULL;
+	for (int i = 0; i < 3; i++)
+		notice("conn %d from %s", i, "192.168.1.1");
+	info("%-5d|%+.3i|%05u|%hhx|%hd|%lx|%lld|%jd|%zu|%td", -1, 7, 3u, 0x1ff, -2,
+			123456789l, -1ll, (intmax_t)9, (size_t)8, (ptrdiff_t)-3);
+	warning("%.2f|%e|%G|%a|%10.3Lf|%%", 3.14159, 1e10, 0.0001, 1.0, 2.5L);
+	error("%*d|%.*s|%.3s|%c|%s|%5s", 4, 1, 2, "text", unterminated, 'x', null, "ab");
+	errno = ENOENT;
+	error("Can't open %s", "file");
+	errno = ENOENT;
+	error("%m and %n", (int[]){0}); // stored as text
+	debug("not logged");
+	log_flush(tlog);
+	log_rm_output(tlog, bin);
+	log_rm_output(tlog, text);
+	fclose(bin);
+
+	char *decoded = decode(path, "full");
+	char *expected = file_content(text);
+	ck_assert_str_eq(decoded, expected);
+	free(decoded);
+	free(expected);
+	fclose(text);
+	unlink(path);
+	errno = 0;
+}
+END_TEST
+
+// Repeated messages are considerably smaller than text
+TEST(binary, binary_size) {
+	char path[] = "/tmp/logc-binary-XXXXXX";
+	FILE *bin = binary_file(path);
+	FILE *text = tmpfile();
+	log_add_binary_output(tlog, bin, 0, 0);
+	log_add_output(tlog, text, 0, 0, LOG_FORMAT_PLAIN);
+
+	for (int i = 0; i < 1000; i++)
+		notice("Connection %d accepted from client on port %u with flags %x", i, 443u, 0x12);
+	log_flush(tlog);
+	struct stat bin_st, text_st;
+	ck_assert_int_eq(fstat(fileno(bin), &bin_st), 0);
+	ck_assert_int_eq(fstat(fileno(text), &text_st), 0);
+	ck_assert_int_lt(bin_st.st_size * 3, text_st.st_size);
+
+	log_rm_output(tlog, bin);
+	log_rm_output(tlog, text);
+	fclose(bin);
+	fclose(text);
+
+	char *decoded = decode(path, "%m");
+	char *line = decoded;
+	for (int i = 0; i < 1000; i++) {
+		char *end = strchr(line, '\n');
+		ck_assert_ptr_nonnull(end);
+		*end = '\0';
+		char *expected;
+		ck_assert_int_ne(asprintf(&expected,
+					"Connection %d accepted from client on port %u with flags %x", i, 443u, 0x12), -1);
+		ck_assert_str_eq(line, expected);
+		free(expected);
+		line = end + 1;
+	}
+	ck_assert_str_eq(line, "");
+	free(decoded);
+	unlink(path);
+	errno = 0;
+}
+END_TEST
@@ -103,6 +103,53 @@ TEST(stderr, sub_output_ignored) {
 }
 END_TEST
 
+// The verbosity threshold is cached in bound logs so it has to follow changes in
+// dominant log.
+TEST(stderr, top_level_change) {
+	log_warning(log_subsub, "This is warning!");
+	log_info(log_subsub, "This is info.");
+	log_verbose(tlog);
+	log_info(log_subsub, "This is info!");
+	const char *res = "WARNING:subsub: This is warning!\nINFO:subsub: This is info!\n";
+	ck_assert_str_eq(stderr_data, res);
+	ck_assert_int_eq(stderr_len, strlen(res));
+}
+END_TEST
+
+TEST(stderr, unbind_level) {
+	log_set_level(tlog, LL_TRACE);
+	log_debug(log_sub, "This is debug!");
+	log_unbind(log_sub);
+	log_debug(log_sub, "This is debug.");
+	const char *res = "DEBUG:sub: This is debug!\n";
+	ck_assert_str_eq(stderr_data, res);
+	ck_assert_int_eq(stderr_len, strlen(res));
+}
+END_TEST
+
+
+TEST_CASE(would_log) {}
+
+TEST(would_log, bound_would_log) {
+	ck_assert(log_would_log(log_subsub, LL_NOTICE));
+	ck_assert(!log_would_log(log_subsub, LL_INFO));
+	log_set_level(tlog, LL_INFO);
+	ck_assert(log_would_log(log_subsub, LL_INFO));
+	log_set_level(log_sub, LL_WARNING - LL_INFO);
+	ck_assert(!log_would_log(log_subsub, LL_NOTICE));
+	ck_assert(log_would_log(log_subsub, LL_WARNING));
+}
+END_TEST
+
+TEST(would_log, output_level) {
+	log_add_output(tlog, stderr, 0, LL_ERROR, LOG_FORMAT_PLAIN);
+	ck_assert(!log_would_log(log_sub, LL_WARNING));
+	ck_assert(log_would_log(log_sub, LL_ERROR));
+	log_rm_output(tlog, stderr);
+	ck_assert(log_would_log(log_sub, LL_WARNING));
+}
+END_TEST
+
 
 static void syslog_setup() {
 	bind_setup();
@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define SUITE "buffer"
+#include "unittests.h"
+
+static FILE *f;
+
+static void setup_buffer() {
+	basic_setup();
+	f = tmpfile();
+}
+
+static void teardown_buffer() {
+	basic_teardown();
+	fclose(f);
+}
+
+TEST_CASE(buffer, setup_buffer, teardown_buffer) {}
+
+static size_t file_size() {
+	struct stat st;
+	ck_assert_int_eq(fstat(fileno(f), &st), 0);
+	return st.st_size;
+}
+
+static void assert_content(const char *expected) {
+	ck_assert_uint_eq(file_size(), strlen(expected));
+	char buf[BUFSIZ];
+	ck_assert_int_eq(pread(fileno(f), buf, sizeof buf, 0), strlen(expected));
+	buf[strlen(expected)] = '\0';
+	ck_assert_str_eq(buf, expected);
+}
+
+TEST(buffer, buffer_flush) {
+	log_add_output(tlog, f, LOG_F_BUFFER, 0, "%m");
+
+	notice("foo");
+	notice("bar");
+	assert_content("");
+
+	log_flush(tlog);
+	assert_content("foo\nbar\n");
+}
+END_TEST
+
+TEST(buffer, buffer_error) {
+	log_add_output(tlog, f, LOG_F_BUFFER, 0, "%m");
+
+	notice("foo");
+	warning("bar");
+	assert_content("");
+	error("fee");
+	assert_content("foo\nbar\nfee\n");
+}
+END_TEST
+
+TEST(buffer, buffer_lines) {
+	log_add_output(tlog, f, LOG_F_BUFFER, 0, "%m");
+
+	for (int i = 0; i < LOG_BUFFER_LINES - 1; i++)
+		notice("x");
+	ck_assert_uint_eq(file_size(), 0);
+	notice("x");
+	ck_assert_uint_eq(file_size(), 2 * LOG_BUFFER_LINES);
+}
+END_TEST
+
+TEST(buffer, buffer_size) {
+	log_add_output(tlog, f, LOG_F_BUFFER, 0, "%m");
+	size_t len = LOG_BUFFER_SIZE / 2;
+	char *line = malloc(len + 1);
+	memset(line, 'a', len);
+	line[len] = '\0';
+
+	notice("%s", line);
+	ck_assert_uint_eq(file_size(), 0);
+	notice("%s", line); // does not fit to the buffer with the first one
+	ck_assert_uint_eq(file_size(), len + 1);
+	log_flush(tlog);
+	ck_assert_uint_eq(file_size(), 2 * (len + 1));
+	free(line);
+}
+END_TEST
+
+TEST(buffer, buffer_timer) {
+	log_add_output(tlog, f, LOG_F_BUFFER_TIMER, 0, "%m");
+
+	notice("foo");
+	for (int i = 0; i < 100 && file_size() == 0; i++)
+		usleep(LOG_BUFFER_INTERVAL * 100);
+	assert_content("foo\n");
+}
+END_TEST
+
+TEST(buffer, buffer_async) {
+	log_add_output(tlog, f, LOG_F_BUFFER | LOG_F_ASYNC, 0, "%m");
+
+	for (int i = 0; i < 3; i++)
+		notice("%d", i);
+	log_flush(tlog);
+
+	assert_content("0\n1\n2\n");
+}
+END_TEST
+
+TEST(buffer, buffer_rm) {
+	log_add_output(tlog, f, LOG_F_BUFFER, 0, "%m");
+
+	notice("foo");
+	ck_assert(log_rm_output(tlog, f));
+
+	assert_content("foo\n");
+}
+END_TEST
+
+TEST(buffer, buffer_exit) {
+	log_add_output(tlog, f, LOG_F_BUFFER, 0, "%m");
+
+	pid_t pid = fork();
+	ck_assert_int_ne(pid, -1);
+	if (pid == 0) {
+		notice("foo");
+		exit(0);
+	}
+	int status;
+	ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+	ck_assert_int_eq(status, 0);
+
+	assert_content("foo\n");
+}
+END_TEST
+
+// Lines buffered before fork are written only once
+TEST(buffer, buffer_fork) {
+	log_add_output(tlog, f, LOG_F_BUFFER, 0, "%m");
+
+	notice("foo");
+	pid_t pid = fork();
+	ck_assert_int_ne(pid, -1);
+	if (pid == 0) {
+		notice("bar");
+		exit(0);
+	}
+	int status;
+	ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+	ck_assert_int_eq(status, 0);
+	assert_content("bar\n");
+
+	log_flush(tlog);
+	assert_content("bar\nfoo\n");
+}
+END_TEST
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <fnmatch.h>
+
+#define SUITE "callsite"
+#include "unittests.h"
+
+static const unsigned trace_line = __LINE__ + 2;
+static void callsite_trace(void) {
+	trace("Trace %d", 42);
+}
+
+static void callsite_debug(void) {
+	debug("Debug");
+}
+
+
+TEST_CASE(enable) {}
+
+TEST(enable, enable_func) {
+	callsite_trace();
+	ck_assert_int_eq(log_callsites_enable(NULL, "callsite_trace", 0, true), 1);
+	callsite_trace();
+	callsite_debug();
+	ck_assert_int_eq(log_callsites_enable(NULL, "callsite_trace", 0, false), 1);
+	callsite_trace();
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "TRACE:tlog: Trace 42\n");
+}
+END_TEST
+
+TEST(enable, enable_file_line) {
+	ck_assert_int_eq(log_callsites_enable("*/logc_callsite.c", NULL, trace_line, true), 1);
+	callsite_trace();
+	callsite_debug();
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "TRACE:tlog: Trace 42\n");
+}
+END_TEST
+
+TEST(enable, enable_file) {
+	ck_assert_int_ge(log_callsites_enable("*/logc_callsite.c", NULL, 0, true), 2);
+	callsite_trace();
+	callsite_debug();
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "TRACE:tlog: Trace 42\nDEBUG:tlog: Debug\n");
+}
+END_TEST
+
+TEST(enable, enable_no_match) {
+	ck_assert_int_eq(log_callsites_enable("nonexistent.c", NULL, 0, true), 0);
+	callsite_trace();
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "");
+}
+END_TEST
+
+TEST(enable, enable_origin) {
+	log_set_use_origin(tlog, true);
+	log_callsites_enable(NULL, "callsite_trace", 0, true);
+	callsite_trace();
+	callsite_trace(); // second time origin is cached
+
+	fflush(stderr);
+	char *expected;
+	asprintf(&expected, "TRACE:tlog(%s:%d,callsite_trace): Trace 42\n", __FILE__, trace_line);
+	char *expected2;
+	asprintf(&expected2, "%s%s", expected, expected);
+	ck_assert_str_eq(stderr_data, expected2);
+	free(expected);
+	free(expected2);
+}
+END_TEST
+
+
+TEST_CASE(foreach) {}
+
+static void foreach_callback(const struct log_callsite *cs, void *data) {
+	if (!fnmatch("*/logc_callsite.c", cs->file, 0) && cs->line == trace_line)
+		*(const struct log_callsite **)data = cs;
+}
+
+TEST(foreach, locate_callsite) {
+	const struct log_callsite *cs = NULL;
+	log_callsites_foreach(foreach_callback, &cs);
+	ck_assert_ptr_nonnull(cs);
+	ck_assert_str_eq(cs->func, "callsite_trace");
+	ck_assert_str_eq(cs->format, "Trace %d");
+	ck_assert_int_eq(cs->level, LL_TRACE);
+}
+END_TEST
+
+TEST(foreach, unregistered_callsites) {
+	_logc_unregister_callsites(__start_logc_callsites, __stop_logc_callsites);
+	const struct log_callsite *cs = NULL;
+	log_callsites_foreach(foreach_callback, &cs);
+	ck_assert_ptr_null(cs);
+	ck_assert_int_eq(log_callsites_enable(NULL, "callsite_trace", 0, true), 0);
+
+	// Rules are applied once module is registered again
+	_logc_register_callsites(__start_logc_callsites, __stop_logc_callsites);
+	log_callsites_foreach(foreach_callback, &cs);
+	ck_assert_ptr_nonnull(cs);
+	callsite_trace();
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "TRACE:tlog: Trace 42\n");
+}
+END_TEST
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <zlib.h>
+
+#define SUITE "compress"
+#include "unittests.h"
+
+static char path[] = "/tmp/logc-compress-XXXXXX";
+
+static void setup_compress() {
+	basic_setup();
+	strcpy(path, "/tmp/logc-compress-XXXXXX");
+	int fd = mkstemp(path);
+	ck_assert_int_ne(fd, -1);
+	close(fd);
+}
+
+static void teardown_compress() {
+	basic_teardown();
+	unlink(path);
+}
+
+TEST_CASE(compress, setup_compress, teardown_compress) {}
+
+// Decompressed content of gzip file
+static char *gunzip(const char *fpath) {
+	gzFile gz = gzopen(fpath, "r");
+	ck_assert_ptr_nonnull(gz);
+	char *res;
+	size_t size;
+	FILE *mem = open_memstream(&res, &size);
+	char buf[BUFSIZ];
+	int len;
+	while ((len = gzread(gz, buf, sizeof buf)) > 0)
+		fwrite(buf, 1, len, mem);
+	ck_assert_int_eq(len, 0);
+	gzclose(gz);
+	fclose(mem);
+	return res;
+}
+
+static void assert_content(const char *expected) {
+	char *data = gunzip(path);
+	ck_assert_str_eq(data, expected);
+	free(data);
+}
+
+static const struct log_compression gzip = {.codec = LOG_CODEC_GZIP};
+
+TEST(compress, gzip_output) {
+	FILE *f = log_add_compressed_output(tlog, path, 0, 0, "%m", &gzip);
+	ck_assert_ptr_nonnull(f);
+
+	notice("foo");
+	notice("bar");
+
+	ck_assert(log_rm_output(tlog, f));
+	assert_content("foo\nbar\n");
+}
+END_TEST
+
+TEST(compress, gzip_flush_frames) {
+	ck_assert_ptr_nonnull(log_add_compressed_output(tlog, path, 0, 0, "%m", &gzip));
+
+	notice("foo");
+	log_flush(tlog);
+	assert_content("foo\n");
+	notice("bar");
+	log_flush(tlog);
+	assert_content("foo\nbar\n");
+}
+END_TEST
+
+TEST(compress, gzip_append) {
+	FILE *f = log_add_compressed_output(tlog, path, 0, 0, "%m", &gzip);
+	notice("foo");
+	ck_assert(log_rm_output(tlog, f));
+
+	ck_assert_ptr_nonnull(log_add_compressed_output(tlog, path, 0, 0, "%m", &gzip));
+	notice("bar");
+	log_flush(tlog);
+
+	assert_content("foo\nbar\n");
+}
+END_TEST
+
+TEST(compress, gzip_frame_interval) {
+	struct log_compression compression = {
+		.codec = LOG_CODEC_GZIP,
+		.level = 9,
+		.frame_interval = 1,
+	};
+	ck_assert_ptr_nonnull(log_add_compressed_output(tlog, path, 0, 0, "%m", &compression));
+
+	notice("foo");
+	sleep(2);
+	notice("bar"); // closes frame without flush
+
+	assert_content("foo\nbar\n");
+}
+END_TEST
+
+TEST(compress, gzip_long_line) {
+	ck_assert_ptr_nonnull(log_add_compressed_output(tlog, path, 0, 0, "%m", &gzip));
+	size_t len = 200 * 1024;
+	char *line = malloc(len + 2);
+	for (size_t i = 0; i < len; i++)
+		line[i] = 'a' + i % 26;
+	line[len] = '\0';
+
+	notice("foo");
+	notice("%s", line);
+	log_flush(tlog);
+
+	line[len] = '\n';
+	line[len + 1] = '\0';
+	char *expected;
+	ck_assert_int_ne(asprintf(&expected, "foo\n%s", line), -1);
+	assert_content(expected);
+	free(expected);
+	free(line);
+}
+END_TEST
+
+TEST(compress, gzip_async) {
+	FILE *f = log_add_compressed_output(tlog, path, LOG_F_ASYNC, 0, "%m", &gzip);
+	ck_assert_ptr_nonnull(f);
+
+	for (int i = 0; i < 3; i++)
+		notice("%d", i);
+	log_flush(tlog);
+
+	assert_content("0\n1\n2\n");
+	ck_assert(log_rm_output(tlog, f));
+	// Content is compressed (gzread accepts uncompressed content as well)
+	FILE *raw = fopen(path, "r");
+	ck_assert_int_eq(fgetc(raw), 0x1f);
+	ck_assert_int_eq(fgetc(raw), 0x8b);
+	fclose(raw);
+}
+END_TEST
+
+TEST(compress, gzip_binary) {
+	ck_assert_ptr_nonnull(log_add_compressed_output(tlog, path, 0, 0, NULL, &gzip));
+	notice("foo %d", 42);
+	log_flush(tlog);
+
+	const char *decoder = getenv("LOGC_DECODE");
+	ck_assert_ptr_nonnull(decoder);
+	char *cmd;
+	ck_assert_int_ne(asprintf(&cmd, "gzip -dc '%s' | '%s' -f '%%m'", path, decoder), -1);
+	FILE *p = popen(cmd, "r");
+	free(cmd);
+	ck_assert_ptr_nonnull(p);
+	char buf[BUFSIZ];
+	size_t len = fread(buf, 1, sizeof buf - 1, p);
+	buf[len] = '\0';
+	ck_assert_int_eq(pclose(p), 0);
+	ck_assert_str_eq(buf, "foo 42\n");
+}
+END_TEST
+
+TEST(compress, unsupported_codec) {
+	struct log_compression compression = {.codec = 42};
+	ck_assert_ptr_null(log_add_compressed_output(tlog, path, 0, 0, "%m", &compression));
+	ck_assert_int_eq(errno, ENOTSUP);
+	errno = 0;
+}
+END_TEST
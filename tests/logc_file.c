@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define SUITE "file"
+#include "unittests.h"
+
+static char dir[] = "/tmp/logc-file-XXXXXX";
+static char *path;
+
+static void setup_file() {
+	basic_setup();
+	strcpy(dir, "/tmp/logc-file-XXXXXX");
+	ck_assert_ptr_nonnull(mkdtemp(dir));
+	ck_assert_int_ne(asprintf(&path, "%s/log", dir), -1);
+}
+
+static int rm_entry(const char *fpath, const struct stat *sb, int typeflag,
+		struct FTW *ftwbuf) {
+	return remove(fpath);
+}
+
+static void teardown_file() {
+	basic_teardown();
+	nftw(dir, rm_entry, 8, FTW_DEPTH | FTW_PHYS);
+	free(path);
+}
+
+TEST_CASE(file, setup_file, teardown_file) {}
+
+// Content of file with given suffix (NULL if it doesn't exist)
+static char *content(const char *suffix) {
+	char *fpath;
+	ck_assert_int_ne(asprintf(&fpath, "%s%s", path, suffix), -1);
+	FILE *f = fopen(fpath, "r");
+	free(fpath);
+	if (f == NULL) {
+		errno = 0;
+		return NULL;
+	}
+	char *res;
+	size_t size;
+	FILE *mem = open_memstream(&res, &size);
+	char buf[BUFSIZ];
+	size_t len;
+	while ((len = fread(buf, 1, sizeof buf, f)))
+		fwrite(buf, 1, len, mem);
+	fclose(mem);
+	fclose(f);
+	return res;
+}
+
+static void assert_content(const char *suffix, const char *expected) {
+	char *data = content(suffix);
+	if (expected == NULL) {
+		ck_assert_ptr_null(data);
+		return;
+	}
+	ck_assert_ptr_nonnull(data);
+	ck_assert_str_eq(data, expected);
+	free(data);
+}
+
+TEST(file, file_append) {
+	FILE *f = fopen(path, "w");
+	fputs("previous\n", f);
+	fclose(f);
+	ck_assert_ptr_nonnull(log_add_file_output(tlog, path, 0, 0, "%m", NULL));
+
+	notice("foo");
+	notice("bar");
+
+	assert_content("", "previous\nfoo\nbar\n");
+}
+END_TEST
+
+TEST(file, file_open_failure) {
+	char *missing;
+	ck_assert_int_ne(asprintf(&missing, "%s/missing/log", dir), -1);
+	ck_assert_ptr_null(log_add_file_output(tlog, missing, 0, 0, "%m", NULL));
+	free(missing);
+	errno = 0;
+}
+END_TEST
+
+TEST(file, file_rotate_size) {
+	// Every line has four bytes so there are two lines in every file
+	struct log_rotation rotation = {.max_size = 10, .keep = 2};
+	FILE *f = log_add_file_output(tlog, path, 0, 0, "%m", &rotation);
+	ck_assert_ptr_nonnull(f);
+
+	for (int i = 0; i < 9; i++)
+		notice("%03d", i);
+
+	assert_content("", "008\n");
+	assert_content(".1", "006\n007\n");
+	assert_content(".2", "004\n005\n");
+	assert_content(".3", NULL);
+	ck_assert(log_rm_output(tlog, f));
+}
+END_TEST
+
+TEST(file, file_rotate_no_keep) {
+	struct log_rotation rotation = {.max_size = 10};
+	ck_assert_ptr_nonnull(log_add_file_output(tlog, path, 0, 0, "%m", &rotation));
+
+	for (int i = 0; i < 3; i++)
+		notice("%03d", i);
+
+	assert_content("", "002\n");
+	assert_content(".1", NULL);
+}
+END_TEST
+
+TEST(file, file_rotate_age) {
+	struct log_rotation rotation = {.max_age = 1, .keep = 1};
+	ck_assert_ptr_nonnull(log_add_file_output(tlog, path, 0, 0, "%m", &rotation));
+
+	notice("foo");
+	sleep(2);
+	notice("bar");
+
+	assert_content("", "bar\n");
+	assert_content(".1", "foo\n");
+}
+END_TEST
+
+static void external_rotation(void (*reopen)(void)) {
+	ck_assert_ptr_nonnull(log_add_file_output(tlog, path, 0, 0, "%m", NULL));
+
+	notice("foo");
+	char *moved;
+	ck_assert_int_ne(asprintf(&moved, "%s.old", path), -1);
+	ck_assert_int_eq(rename(path, moved), 0);
+	free(moved);
+	notice("bar");
+	reopen();
+	notice("baz");
+
+	assert_content(".old", "foo\nbar\n");
+	assert_content("", "baz\n");
+}
+
+TEST(file, file_reopen) {
+	external_rotation(log_reopen_files);
+}
+END_TEST
+
+static void raise_sighup() {
+	raise(SIGHUP);
+}
+
+TEST(file, file_reopen_sighup) {
+	ck_assert(log_reopen_on_sighup());
+	external_rotation(raise_sighup);
+	signal(SIGHUP, SIG_DFL);
+}
+END_TEST
@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 // Copyright 2020-2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
 #include <signal.h>
+#include <stdlib.h>
+#include <regex.h>
+#include <time.h>
 
 #define SUITE "formats"
 #include "unittests.h"
@@ -78,6 +81,17 @@ TEST(origin, check_origin_disabled_format) {
 }
 END_TEST
 
+// Unguarded origin sequence outputs empty fields when origin is disabled
+TEST(origin, check_origin_unguarded) {
+	log_add_output(tlog, stderr, 0, LL_INFO, "%n(%f:%i,%c) %m");
+
+	log_notice(tlog, "foo");
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "tlog(:,) foo\n");
+}
+END_TEST
+
 TEST(origin, check_origin_format) {
 	log_add_output(tlog, stderr, 0, LL_INFO, LOG_FP_ORIGIN " %m");
 	log_set_use_origin(tlog, true);
@@ -118,3 +132,98 @@ TEST(predefined, full_format) {
 	ck_assert_int_eq(stderr_len, strlen(expected));
 }
 END_TEST
+
+
+TEST_CASE(time) {}
+
+static void assert_match(const char *str, const char *pattern) {
+	regex_t re;
+	ck_assert_int_eq(regcomp(&re, pattern, REG_EXTENDED | REG_NOSUB), 0);
+	int res = regexec(&re, str, 0, NULL, 0);
+	regfree(&re);
+	ck_assert_msg(res == 0, "'%s' does not match '%s'", str, pattern);
+}
+
+#define DATE "[0-9]{4}-[0-9]{2}-[0-9]{2}T[0-9]{2}:[0-9]{2}:[0-9]{2}"
+
+TEST(time, time_fields) {
+	log_add_output(tlog, stderr, 0, 0,
+			"%Ti%T3|%Tu|%Tz|%Tr|%Ts%T6|%Tm|%Te%T9|%T3|%m");
+
+	log_notice(tlog, "foo");
+
+	fflush(stderr);
+	assert_match(stderr_data, "^" DATE "\\.[0-9]{3}\\|" DATE "\\|[+-][0-9]{2}:[0-9]{2}\\|"
+			DATE "\\.[0-9]{6}[+-][0-9]{2}:[0-9]{2}\\|[0-9]+\\.[0-9]{6}\\|[0-9]+\\|"
+			"[0-9]+\\.[0-9]{9}\\|\\.[0-9]{3}\\|foo\n$");
+}
+END_TEST
+
+TEST(time, time_utc) {
+	setenv("TZ", "UTC", true);
+	tzset();
+	log_add_output(tlog, stderr, 0, 0, "%Ti %Tu %Tz %Ts");
+
+	time_t before = time(NULL);
+	log_notice(tlog, "foo");
+	time_t after = time(NULL);
+
+	fflush(stderr);
+	char local[32], utc[32], zone[8];
+	long long epoch;
+	ck_assert_int_eq(sscanf(stderr_data, "%31s %31s %7s %lld", local, utc, zone, &epoch), 4);
+	ck_assert_str_eq(local, utc);
+	ck_assert_str_eq(zone, "+00:00");
+	ck_assert_int_ge(epoch, before);
+	ck_assert_int_le(epoch, after);
+	struct tm tm;
+	char expected[32];
+	time_t t = epoch;
+	strftime(expected, sizeof expected, "%Y-%m-%dT%H:%M:%S", gmtime_r(&t, &tm));
+	ck_assert_str_eq(utc, expected);
+}
+END_TEST
+
+TEST(time, time_condition) {
+	log_add_output(tlog, stderr, 0, 0, "%(_%Ts %)%m");
+
+	log_notice(tlog, "%s", "");
+
+	fflush(stderr);
+	assert_match(stderr_data, "^[0-9]+ \n$");
+}
+END_TEST
+
+static const enum log_clock clocks[] = {
+	LOG_CLOCK_REALTIME,
+	LOG_CLOCK_REALTIME_COARSE,
+	LOG_CLOCK_TSC,
+};
+
+ARRAY_TEST(time, time_clock, clocks) {
+	log_add_output(tlog, stderr, 0, 0, "%Ts %Tm");
+
+	if (!log_set_clock(_d)) {
+		ck_assert_int_eq(_d, LOG_CLOCK_TSC); // TSC might not be available
+		ck_assert_int_eq(log_clock(), LOG_CLOCK_REALTIME);
+		return;
+	}
+	ck_assert_int_eq(log_clock(), _d);
+	struct timespec before, after;
+	clock_gettime(CLOCK_MONOTONIC, &before);
+	time_t real_before = time(NULL);
+	log_notice(tlog, "foo");
+	time_t real_after = time(NULL);
+	clock_gettime(CLOCK_MONOTONIC, &after);
+	log_set_clock(LOG_CLOCK_REALTIME);
+
+	fflush(stderr);
+	long long real, mono;
+	ck_assert_int_eq(sscanf(stderr_data, "%lld %lld", &real, &mono), 2);
+	// Coarse and calibrated clocks can lag behind the precise one a bit
+	ck_assert_int_ge(real, real_before - 1);
+	ck_assert_int_le(real, real_after + 1);
+	ck_assert_int_ge(mono, before.tv_sec - 1);
+	ck_assert_int_le(mono, after.tv_sec + 1);
+}
+END_TEST
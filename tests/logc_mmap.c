@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#define SUITE "mmap"
+#include "unittests.h"
+
+static char path[] = "/tmp/logc-mmap-XXXXXX";
+
+static void setup_mmap() {
+	basic_setup();
+	strcpy(path, "/tmp/logc-mmap-XXXXXX");
+	int fd = mkstemp(path);
+	ck_assert_int_ne(fd, -1);
+	close(fd);
+}
+
+static void teardown_mmap() {
+	basic_teardown();
+	unlink(path);
+}
+
+TEST_CASE(mmap, setup_mmap, teardown_mmap) {}
+
+static char *content(size_t *size) {
+	FILE *f = fopen(path, "r");
+	ck_assert_ptr_nonnull(f);
+	char *res;
+	FILE *mem = open_memstream(&res, size);
+	char buf[BUFSIZ];
+	size_t len;
+	while ((len = fread(buf, 1, sizeof buf, f)))
+		fwrite(buf, 1, len, mem);
+	fclose(mem);
+	fclose(f);
+	return res;
+}
+
+static void assert_content(const char *expected) {
+	size_t size;
+	char *data = content(&size);
+	ck_assert_uint_eq(size, strlen(expected));
+	ck_assert_str_eq(data, expected);
+	free(data);
+}
+
+TEST(mmap, mmap_output) {
+	FILE *f = log_add_mmap_output(tlog, path, 0, 0, "%m", NULL);
+	ck_assert_ptr_nonnull(f);
+
+	notice("foo");
+	notice("bar");
+
+	ck_assert(log_rm_output(tlog, f));
+	assert_content("foo\nbar\n");
+}
+END_TEST
+
+TEST(mmap, mmap_flush) {
+	struct log_mmap mmap = {.region = 4096};
+	FILE *f = log_add_mmap_output(tlog, path, 0, 0, "%m", &mmap);
+	notice("foo");
+	log_flush(tlog);
+
+	// File is preallocated so it is larger than written lines
+	size_t size;
+	char *data = content(&size);
+	ck_assert_uint_eq(size, 4096);
+	ck_assert_str_eq(data, "foo\n");
+	free(data);
+	ck_assert(log_rm_output(tlog, f));
+}
+END_TEST
+
+TEST(mmap, mmap_append) {
+	FILE *f = fopen(path, "w");
+	fputs("previous\n", f);
+	fwrite("\0\0\0", 1, 3, f); // leftover of unclean exit
+	fclose(f);
+	f = log_add_mmap_output(tlog, path, 0, 0, "%m", NULL);
+
+	notice("foo");
+
+	ck_assert(log_rm_output(tlog, f));
+	assert_content("previous\nfoo\n");
+}
+END_TEST
+
+TEST(mmap, mmap_extend) {
+	// Every line has four bytes so every line needs new region
+	struct log_mmap mmap = {.region = 3};
+	FILE *f = log_add_mmap_output(tlog, path, 0, 0, "%m", &mmap);
+
+	for (int i = 0; i < 4; i++)
+		notice("%03d", i);
+
+	ck_assert(log_rm_output(tlog, f));
+	assert_content("000\n001\n002\n003\n");
+}
+END_TEST
+
+TEST(mmap, mmap_full) {
+	struct log_mmap mmap = {.region = 4, .max_size = 10};
+	FILE *f = log_add_mmap_output(tlog, path, 0, 0, "%m", &mmap);
+
+	for (int i = 0; i < 5; i++)
+		notice("%03d", i);
+
+	ck_assert_uint_eq(log_output_dropped(tlog, f), 3);
+	ck_assert(log_rm_output(tlog, f));
+	assert_content("000\n001\n");
+}
+END_TEST
+
+TEST(mmap, mmap_open_failure) {
+	ck_assert_ptr_null(log_add_mmap_output(tlog, "/dev/null/log", 0, 0, "%m", NULL));
+	errno = 0;
+}
+END_TEST
+
+#define LINES 1000
+
+// Every line has to be complete and every writer has to write all its lines
+static void assert_lines(const char *data, unsigned writers) {
+	unsigned counts[writers];
+	memset(counts, 0, sizeof counts);
+	for (const char *line = data; *line; line = strchr(line, '\n') + 1) {
+		unsigned writer, i;
+		ck_assert_int_eq(sscanf(line, "%u:%u\n", &writer, &i), 2);
+		ck_assert_uint_lt(writer, writers);
+		counts[writer]++;
+	}
+	for (unsigned i = 0; i < writers; i++)
+		ck_assert_uint_eq(counts[i], LINES);
+}
+
+static void *writer(void *arg) {
+	unsigned id = (uintptr_t)arg;
+	for (unsigned i = 0; i < LINES; i++)
+		notice("%u:%u", id, i);
+	return NULL;
+}
+
+TEST(mmap, mmap_threads) {
+	struct log_mmap mmap = {.region = 512};
+	FILE *f = log_add_mmap_output(tlog, path, 0, 0, "%m", &mmap);
+
+	pthread_t threads[4];
+	for (unsigned i = 0; i < 4; i++)
+		pthread_create(&threads[i], NULL, writer, (void *)(uintptr_t)i);
+	for (unsigned i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+
+	ck_assert(log_rm_output(tlog, f));
+	size_t size;
+	char *data = content(&size);
+	assert_lines(data, 4);
+	free(data);
+}
+END_TEST
+
+TEST(mmap, mmap_fork) {
+	struct log_mmap mmap = {.region = 512};
+	FILE *f = log_add_mmap_output(tlog, path, 0, 0, "%m", &mmap);
+
+	pid_t pid = fork();
+	ck_assert_int_ne(pid, -1);
+	writer((void *)(uintptr_t)(pid == 0));
+	if (pid == 0) {
+		log_rm_output(tlog, f);
+		_exit(0);
+	}
+	int status;
+	ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+	ck_assert_int_eq(status, 0);
+
+	ck_assert(log_rm_output(tlog, f));
+	size_t size;
+	char *data = content(&size);
+	assert_lines(data, 2);
+	free(data);
+}
+END_TEST
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <string.h>
+#include <time.h>
+
+#define SUITE "ratelimit"
+#include "unittests.h"
+
+static void setup_ratelimit() {
+	basic_setup();
+	log_add_output(tlog, stderr, 0, 0, "%m");
+}
+
+TEST_CASE(ratelimit, setup_ratelimit) {}
+
+static void sleep_ms(long ms) {
+	nanosleep(&(struct timespec){.tv_sec = ms / 1000, .tv_nsec = ms % 1000 * 1000000}, NULL);
+}
+
+TEST(ratelimit, ratelimit_burst) {
+	for (int i = 0; i < 3 * LOG_RATELIMIT_BURST; i++)
+		error_ratelimited("%d", i);
+
+	fflush(stderr);
+	char *expected = NULL;
+	size_t len;
+	FILE *f = open_memstream(&expected, &len);
+	for (int i = 0; i < LOG_RATELIMIT_BURST; i++)
+		fprintf(f, "%d\n", i);
+	fclose(f);
+	ck_assert_str_eq(stderr_data, expected);
+	free(expected);
+}
+END_TEST
+
+static void limited(int i) {
+	logc_ratelimited(tlog, LL_WARNING, 2, 200, "%d", i);
+}
+
+TEST(ratelimit, ratelimit_summary) {
+	for (int i = 0; i < 5; i++)
+		limited(i);
+	// Single token is regained after 100 ms
+	sleep_ms(150);
+	limited(5);
+	limited(6);
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "0\n1\nSuppressed 3 similar messages\n5\n");
+}
+END_TEST
+
+TEST(ratelimit, ratelimit_flush) {
+	for (int i = 0; i < 5; i++)
+		limited(i);
+	// Count of suppressed messages is reported only with the next passed one
+	log_flush(tlog);
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "0\n1\n");
+}
+END_TEST
+
+TEST(ratelimit, ratelimit_verbosity) {
+	// Messages that are not logged do not consume tokens
+	log_set_level(tlog, LL_ERROR);
+	for (int i = 0; i < 5; i++)
+		logc_ratelimited(tlog, LL_WARNING, 1, 10000, "%d", i);
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "");
+}
+END_TEST
+
+
+static void setup_dedup() {
+	basic_setup();
+	log_add_output(tlog, stderr, LOG_F_DEDUP, 0, "%(_%n: %)%m");
+}
+
+TEST_CASE(dedup, setup_dedup) {}
+
+TEST(dedup, dedup_repeated) {
+	for (int i = 0; i < 4; i++)
+		notice("foo");
+	notice("bar");
+	warning("bar");
+	warning("bar");
+	notice("foo");
+	log_flush(tlog);
+
+	ck_assert_str_eq(stderr_data,
+			"tlog: foo\n"
+			"tlog: last message repeated 3 times\n"
+			"tlog: bar\n"
+			"tlog: bar\n"
+			"tlog: last message repeated 1 times\n"
+			"tlog: foo\n");
+}
+END_TEST
+
+TEST(dedup, dedup_flush) {
+	notice("foo");
+	notice("foo");
+	log_flush(tlog);
+	notice("foo");
+	log_flush(tlog);
+	log_flush(tlog);
+
+	ck_assert_str_eq(stderr_data,
+			"tlog: foo\n"
+			"tlog: last message repeated 1 times\n"
+			"tlog: last message repeated 1 times\n");
+}
+END_TEST
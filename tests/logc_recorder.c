@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define SUITE "recorder"
+#include "unittests.h"
+
+static FILE *f;
+
+static void setup_recorder() {
+	basic_setup();
+	f = tmpfile();
+}
+
+static void teardown_recorder() {
+	basic_teardown();
+	fclose(f);
+}
+
+TEST_CASE(recorder, setup_recorder, teardown_recorder) {}
+
+static void collect(const char *line, size_t len, void *data) {
+	char **lines = data;
+	size_t prev = *lines ? strlen(*lines) : 0;
+	*lines = realloc(*lines, prev + len + 1);
+	memcpy(*lines + prev, line, len);
+	(*lines)[prev + len] = '\0';
+}
+
+static void assert_recorded(const char *format, size_t cnt, const char *expected) {
+	char *lines = NULL;
+	ck_assert_uint_eq(log_recorder_foreach(tlog, format, collect, &lines), cnt);
+	ck_assert_str_eq(lines ?: "", expected);
+	free(lines);
+}
+
+static void assert_content(FILE *file, const char *expected) {
+	char buf[BUFSIZ];
+	ssize_t len = pread(fileno(file), buf, sizeof buf - 1, 0);
+	ck_assert_int_ge(len, 0);
+	buf[len] = '\0';
+	ck_assert_str_eq(buf, expected);
+}
+
+TEST(recorder, recorder_foreach) {
+	log_set_recorder(tlog, 8);
+
+	trace("foo");
+	debug("%d %s", 42, "fee");
+	notice("bar");
+
+	assert_recorded("%m", 3, "foo\n42 fee\nbar\n");
+	assert_recorded("%(D%(N!%)%|~%)%n: %m", 3, "~tlog: foo\ntlog: 42 fee\n!tlog: bar\n");
+	ck_assert_str_eq(stderr_data, "NOTICE:tlog: bar\n");
+}
+END_TEST
+
+TEST(recorder, recorder_errno) {
+	log_set_recorder(tlog, 8);
+
+	errno = ENOENT;
+	debug("foo: %m");
+	errno = 0;
+
+	assert_recorded("%m", 1, "foo: No such file or directory\n");
+}
+END_TEST
+
+TEST(recorder, recorder_long) {
+	log_set_recorder(tlog, 8);
+	char line[2048];
+	memset(line, 'x', sizeof line - 1);
+	line[sizeof line - 1] = '\0';
+
+	debug("%s", line);
+
+	char *lines = NULL;
+	ck_assert_uint_eq(log_recorder_foreach(tlog, "%m", collect, &lines), 1);
+	ck_assert_uint_eq(strspn(lines, "x"), 255);
+	free(lines);
+}
+END_TEST
+
+TEST(recorder, recorder_wrap) {
+	log_set_recorder(tlog, 3);
+
+	for (int i = 0; i < 5; i++)
+		debug("%d", i);
+
+	assert_recorded("%m", 3, "2\n3\n4\n");
+}
+END_TEST
+
+TEST(recorder, recorder_disable) {
+	log_set_recorder(tlog, 3);
+	debug("foo");
+	log_set_recorder(tlog, 0);
+	debug("bar");
+
+	assert_recorded("%m", 0, "");
+	ck_assert(!log_would_log(tlog, LL_DEBUG));
+}
+END_TEST
+
+TEST(recorder, recorder_dump) {
+	log_set_recorder(tlog, 8);
+	log_add_output(tlog, f, 0, 0, "%m");
+
+	debug("foo");
+	notice("bar");
+	assert_content(f, "bar\n");
+
+	log_recorder_dump(tlog);
+	assert_content(f, "bar\nfoo\n");
+	// Messages are dumped only once
+	log_recorder_dump(tlog);
+	assert_content(f, "bar\nfoo\n");
+}
+END_TEST
+
+TEST(recorder, recorder_dump_outputs) {
+	FILE *f2 = tmpfile();
+	log_set_recorder(tlog, 8);
+	log_add_output(tlog, f, 0, 0, "%m");
+	log_add_output(tlog, f2, 0, LL_DEBUG, "%m");
+
+	trace("foo");
+	debug("bar");
+	assert_content(f, "");
+	assert_content(f2, "bar\n");
+
+	log_recorder_dump(tlog);
+	assert_content(f, "foo\nbar\n");
+	assert_content(f2, "bar\nfoo\n");
+	log_rm_output(tlog, f2);
+	fclose(f2);
+}
+END_TEST
+
+static int run_child(void (*child)()) {
+	pid_t pid = fork();
+	ck_assert_int_ne(pid, -1);
+	if (pid == 0) {
+		child();
+		exit(0);
+	}
+	int status;
+	ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+	return status;
+}
+
+static void critical_child() {
+	debug("foo");
+	critical("bar");
+}
+
+TEST(recorder, recorder_critical) {
+	log_set_recorder(tlog, 8);
+	log_add_output(tlog, f, 0, 0, "%m");
+
+	int status = run_child(critical_child);
+	ck_assert(WIFSIGNALED(status));
+	ck_assert_int_eq(WTERMSIG(status), SIGABRT);
+
+	assert_content(f, "foo\nbar\n");
+}
+END_TEST
+
+static void crash_child() {
+	ck_assert(log_recorder_on_crash());
+	debug("foo");
+	info("bar");
+	raise(SIGSEGV);
+}
+
+TEST(recorder, recorder_crash) {
+	log_set_recorder(tlog, 8);
+	log_add_output(tlog, f, LOG_F_BUFFER, 0, "%m");
+
+	int status = run_child(crash_child);
+	ck_assert(WIFSIGNALED(status));
+	ck_assert_int_eq(WTERMSIG(status), SIGSEGV);
+
+	assert_content(f, "foo\nbar\n");
+}
+END_TEST
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <string.h>
+#include <stddef.h>
+
+#define SUITE "sampling"
+#include "unittests.h"
+
+static void setup_sampling() {
+	basic_setup();
+	log_set_level(tlog, LL_TRACE);
+	log_add_output(tlog, stderr, 0, 0, "%m%(_ (1/%S)%)");
+}
+
+TEST_CASE(sampling, setup_sampling) {}
+
+static size_t count_lines(const char *str, const char *suffix) {
+	size_t cnt = 0;
+	for (const char *line = str; *line; line = strchr(line, '\n') + 1) {
+		const char *end = strchr(line, '\n');
+		size_t len = strlen(suffix);
+		if (end - line >= (ptrdiff_t)len && !strncmp(end - len, suffix, len))
+			cnt++;
+	}
+	return cnt;
+}
+
+TEST(sampling, sample_every) {
+	for (int i = 0; i < 10; i++)
+		logc_sampled(tlog, LL_TRACE, LOG_SAMPLE_EVERY, 4, 0, "%d", i);
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "0 (1/4)\n4 (1/4)\n8 (1/4)\n");
+}
+END_TEST
+
+TEST(sampling, sample_first) {
+	for (int i = 0; i < 10; i++)
+		logc_sampled(tlog, LL_DEBUG, LOG_SAMPLE_FIRST, 3, 2, "%d", i);
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "0\n1\n2 (1/3)\n5 (1/3)\n8 (1/3)\n");
+}
+END_TEST
+
+TEST(sampling, sample_random) {
+	const int cnt = 10000;
+	for (int i = 0; i < cnt; i++)
+		trace_sampled(10, "x");
+
+	fflush(stderr);
+	size_t lines = count_lines(stderr_data, "x (1/10)");
+	ck_assert_int_gt(lines, cnt / 10 / 2);
+	ck_assert_int_lt(lines, cnt / 10 * 2);
+}
+END_TEST
+
+TEST(sampling, sample_verbosity) {
+	// Messages that are not logged are not counted
+	log_set_level(tlog, LL_INFO);
+	for (int i = 0; i < 3; i++)
+		logc_sampled(tlog, LL_DEBUG, LOG_SAMPLE_EVERY, 2, 0, "no");
+	log_set_level(tlog, LL_TRACE);
+	for (int i = 0; i < 3; i++)
+		logc_sampled(tlog, LL_DEBUG, LOG_SAMPLE_EVERY, 2, 0, "%d", i);
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data, "0 (1/2)\n2 (1/2)\n");
+}
+END_TEST
+
+TEST(sampling, sample_log) {
+	log_set_sampling(tlog, LL_DEBUG, LOG_SAMPLE_EVERY, 3, 0);
+	for (int i = 0; i < 6; i++) {
+		debug("d%d", i);
+		info("i%d", i);
+	}
+	// Callsite and log sampling multiply
+	for (int i = 0; i < 12; i++)
+		logc_sampled(tlog, LL_TRACE, LOG_SAMPLE_EVERY, 2, 0, "t%d", i);
+	log_set_sampling(tlog, LL_DEBUG, LOG_SAMPLE_ALL, 0, 0);
+	debug("all");
+
+	fflush(stderr);
+	ck_assert_str_eq(stderr_data,
+			"d0 (1/3)\ni0\ni1\ni2\nd3 (1/3)\ni3\ni4\ni5\n"
+			"t0 (1/6)\nt6 (1/6)\nall\n");
+}
+END_TEST
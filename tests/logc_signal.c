@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#define SUITE "signal"
+#include "unittests.h"
+
+static const enum log_signal_safety safety_modes[] = {
+	LOG_SIG_DEFER,
+	LOG_SIG_MASK,
+	LOG_SIG_MASK_WRITE,
+};
+
+static volatile sig_atomic_t signals;
+
+static void signal_handler(int sig) {
+	int orig_errno = errno;
+	signals++;
+	notice("signal");
+	errno = orig_errno;
+}
+
+static void signal_setup() {
+	basic_setup();
+	signals = 0;
+	struct sigaction sa = {
+		.sa_handler = signal_handler,
+		.sa_flags = SA_RESTART,
+	};
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGPROF, &sa, NULL);
+}
+
+static void signal_teardown() {
+	signal(SIGPROF, SIG_DFL);
+	log_set_signal_safety(LOG_SIG_DEFER);
+	basic_teardown();
+}
+
+TEST_CASE(signal, signal_setup, signal_teardown) {}
+
+static ssize_t raising_write(void *cookie, const char *buf, size_t size) {
+	FILE *f = cookie;
+	fwrite(buf, 1, size, f);
+	if (signals == 0)
+		raise(SIGPROF);
+	return size;
+}
+
+// Signal delivered while line is being written is outputted after that line
+ARRAY_TEST(signal, interrupted_write, safety_modes) {
+	log_set_signal_safety(_d);
+	ck_assert_int_eq(log_signal_safety(), _d);
+	char *buf;
+	size_t bufsiz;
+	FILE *mem = open_memstream(&buf, &bufsiz);
+	FILE *f = fopencookie(mem, "w", (cookie_io_functions_t){.write = raising_write});
+	setvbuf(f, NULL, _IONBF, 0);
+	log_add_output(tlog, f, 0, 0, "%m");
+
+	notice("main");
+
+	log_rm_output(tlog, f);
+	fclose(f);
+	fclose(mem);
+	ck_assert_int_ge(signals, 1);
+	ck_assert_str_eq(buf, "main\nsignal\n");
+	free(buf);
+}
+END_TEST
+
+static void critical_handler(int sig) {
+	int orig_errno = errno;
+	signals++;
+	char payload[300];
+	memset(payload, 'x', sizeof payload - 1);
+	payload[sizeof payload - 1] = '\0';
+	logc(tlog, LL_CRITICAL, "%s", payload);
+	errno = orig_errno;
+}
+
+// Critical message from signal handler that interrupted logging is deferred
+// (truncated) and written directly to standard error as well
+TEST(signal, interrupted_critical) {
+	signal(SIGPROF, critical_handler);
+	FILE *err = tmpfile();
+	int orig_err = dup(STDERR_FILENO);
+	dup2(fileno(err), STDERR_FILENO);
+	char *buf;
+	size_t bufsiz;
+	FILE *mem = open_memstream(&buf, &bufsiz);
+	FILE *f = fopencookie(mem, "w", (cookie_io_functions_t){.write = raising_write});
+	setvbuf(f, NULL, _IONBF, 0);
+	log_add_output(tlog, f, 0, 0, "%m");
+
+	notice("main");
+
+	log_rm_output(tlog, f);
+	fclose(f);
+	fclose(mem);
+	dup2(orig_err, STDERR_FILENO);
+	close(orig_err);
+	ck_assert_int_eq(signals, 1);
+	char expected[300];
+	memset(expected, 'x', 255);
+	strcpy(expected + 255, "\n");
+	ck_assert_str_eq(buf + strlen("main\n"), expected);
+	free(buf);
+
+	char line[BUFSIZ];
+	ssize_t len = pread(fileno(err), line, sizeof line - 1, 0);
+	ck_assert_int_ge(len, 0);
+	line[len] = '\0';
+	ck_assert_str_eq(line + strlen("CRITICAL:tlog: "), expected);
+	ck_assert_int_eq(strncmp(line, "CRITICAL:tlog: ", strlen("CRITICAL:tlog: ")), 0);
+	fclose(err);
+}
+END_TEST
+
+static void recorder_handler(int sig) {
+	int orig_errno = errno;
+	signals++;
+	debug("recorded");
+	logc(tlog, LL_CRITICAL, "critical");
+	errno = orig_errno;
+}
+
+// Flight recorder is dumped by interrupted call, not by signal handler
+TEST(signal, interrupted_recorder) {
+	signal(SIGPROF, recorder_handler);
+	log_set_recorder(tlog, 8);
+	int orig_err = dup(STDERR_FILENO);
+	int null = open("/dev/null", O_WRONLY);
+	dup2(null, STDERR_FILENO);
+	close(null);
+	char *buf;
+	size_t bufsiz;
+	FILE *mem = open_memstream(&buf, &bufsiz);
+	FILE *f = fopencookie(mem, "w", (cookie_io_functions_t){.write = raising_write});
+	setvbuf(f, NULL, _IONBF, 0);
+	log_add_output(tlog, f, 0, 0, "%m");
+
+	notice("main");
+
+	log_rm_output(tlog, f);
+	fclose(f);
+	fclose(mem);
+	dup2(orig_err, STDERR_FILENO);
+	close(orig_err);
+	ck_assert_int_eq(signals, 1);
+	ck_assert_str_eq(buf, "main\nrecorded\ncritical\n");
+	free(buf);
+}
+END_TEST
+
+// Lines are not corrupted nor lost when signals are delivered at random moments
+ARRAY_TEST(signal, stress, safety_modes) {
+	log_set_signal_safety(_d);
+	FILE *f = tmpfile();
+	log_add_output(tlog, f, 0, 0, "%m");
+
+	char payload[200];
+	memset(payload, 'x', sizeof payload - 1);
+	payload[sizeof payload - 1] = '\0';
+
+	struct itimerval timer = {
+		.it_interval = {.tv_usec = 100},
+		.it_value = {.tv_usec = 100},
+	};
+	setitimer(ITIMER_PROF, &timer, NULL);
+	const int lines = 20000;
+	for (int i = 0; i < lines; i++)
+		notice("main %s", payload);
+	timer = (struct itimerval){0};
+	setitimer(ITIMER_PROF, &timer, NULL);
+	log_rm_output(tlog, f);
+
+	char *main_line;
+	ck_assert_int_gt(asprintf(&main_line, "main %s\n", payload), 0);
+	int main_cnt = 0, signal_cnt = 0;
+	char *line = NULL;
+	size_t line_size = 0;
+	rewind(f);
+	while (getline(&line, &line_size, f) != -1) {
+		if (!strcmp(line, main_line))
+			main_cnt++;
+		else {
+			ck_assert_str_eq(line, "signal\n");
+			signal_cnt++;
+		}
+	}
+	ck_assert_int_eq(main_cnt, lines);
+	ck_assert_int_gt(signals, 0);
+	ck_assert_int_eq(signal_cnt, signals);
+	free(line);
+	free(main_line);
+	fclose(f);
+}
+END_TEST
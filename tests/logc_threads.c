@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+#include <pthread.h>
+#include <string.h>
+
+#define SUITE "threads"
+#include "unittests.h"
+
+#define WORKERS 16
+#define LINES 2000
+
+TEST_CASE(threads) {}
+
+static void *worker(void *data) {
+	int id = (int)(intptr_t)data;
+	for (int i = 0; i < LINES; i++)
+		notice("%d %d", id, i);
+	return NULL;
+}
+
+// Outputs and other configuration are modified while other threads are logging
+TEST(threads, reconfigure) {
+	FILE *f = tmpfile();
+	log_add_output(tlog, f, 0, 0, "%m");
+	char *buf;
+	size_t bufsiz;
+	FILE *mem = open_memstream(&buf, &bufsiz);
+
+	pthread_t threads[WORKERS];
+	for (int i = 0; i < WORKERS; i++)
+		pthread_create(&threads[i], NULL, worker, (void*)(intptr_t)i);
+	for (int i = 0; i < 200; i++) {
+		log_add_output(tlog, mem, 0, i % 2, LOG_FORMAT_DEFAULT);
+		log_add_output(tlog, f, 0, 0, i % 2 ? "%m" : "%(N%m%)");
+		log_set_use_origin(tlog, i % 2);
+		log_set_level(tlog, -(i % 2));
+		log_rm_output(tlog, mem);
+	}
+	for (int i = 0; i < WORKERS; i++)
+		pthread_join(threads[i], NULL);
+	log_rm_output(tlog, f);
+	fclose(mem);
+	free(buf);
+
+	int received[WORKERS] = {0};
+	int id, line;
+	rewind(f);
+	while (fscanf(f, "%d %d\n", &id, &line) == 2) {
+		ck_assert_int_ge(id, 0);
+		ck_assert_int_lt(id, WORKERS);
+		ck_assert_int_eq(line, received[id]++);
+	}
+	ck_assert(feof(f));
+	for (int i = 0; i < WORKERS; i++)
+		ck_assert_int_eq(received[i], LINES);
+	fclose(f);
+}
+END_TEST
+
+static void *stderr_worker(void *data) {
+	for (int i = 0; i < 100; i++)
+		notice("line");
+	return NULL;
+}
+
+// Default output to stderr is created by multiple threads at once
+TEST(threads, default_stderr) {
+	pthread_t threads[WORKERS];
+	for (int i = 0; i < WORKERS; i++)
+		pthread_create(&threads[i], NULL, stderr_worker, NULL);
+	for (int i = 0; i < WORKERS; i++)
+		pthread_join(threads[i], NULL);
+
+	fflush(stderr);
+	size_t lines = 0;
+	for (const char *line = stderr_data; *line; line += strlen("NOTICE:tlog: line\n")) {
+		ck_assert_int_eq(strncmp(line, "NOTICE:tlog: line\n", strlen("NOTICE:tlog: line\n")), 0);
+		lines++;
+	}
+	ck_assert_uint_eq(lines, WORKERS * 100);
+}
+END_TEST
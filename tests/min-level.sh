@@ -0,0 +1,24 @@
+#!/bin/bash
+# Verify that messages bellow LOGC_MIN_LEVEL are removed from compiled code.
+# The first argument is library compiled with LOGC_MIN_LEVEL=LL_INFO and second
+# one is the same code compiled without LOGC_MIN_LEVEL.
+set -eu
+stripped="$1"
+control="$2"
+
+fail() {
+	echo "$*" >&2
+	exit 1
+}
+
+for marker in MIN_LEVEL_TRACE MIN_LEVEL_DEBUG MIN_LEVEL_LOG_TRACE MIN_LEVEL_LOG_DEBUG MIN_LEVEL_LOGC; do
+	grep -qa "$marker" "$control" \
+		|| fail "Message is missing in control build: $marker"
+	! grep -qa "$marker" "$stripped" \
+		|| fail "Message was not removed: $marker"
+done
+
+nm -u "$control" | grep -qw '_logc_callsite' \
+	|| fail "Control build does not reference _logc_callsite"
+! nm -u "$stripped" | grep -qw '_logc_callsite' \
+	|| fail "Build with minimal level still references _logc_callsite"
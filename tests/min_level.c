@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+// This file is compiled with and without LOGC_MIN_LEVEL and result is verified
+// by min-level.sh. It has to contain only messages that are bellow LL_INFO.
+#define DEFLOG log_min_level
+#include <logc.h>
+
+LOG(min_level);
+
+void min_level_messages(int arg) {
+	trace("MIN_LEVEL_TRACE %d", arg);
+	debug("MIN_LEVEL_DEBUG %d", arg);
+	log_trace(log_min_level, "MIN_LEVEL_LOG_TRACE %d", arg);
+	log_debug(log_min_level, "MIN_LEVEL_LOG_DEBUG %d", arg);
+	logc(log_min_level, LL_DEBUG, "MIN_LEVEL_LOGC %d", arg);
+}
@@ -0,0 +1,305 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+// Decoder of binary log output (log_add_binary_output) to text
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include "log.h"
+#include "binary.h"
+#include "output.h"
+#include "record.h"
+#include "timestamp.h"
+
+LOG(decode)
+
+static const struct {
+	const char *name;
+	const char *format;
+} named_formats[] = {
+	{"plain", LOG_FORMAT_PLAIN},
+	{"default", LOG_FORMAT_DEFAULT},
+	{"full", LOG_FORMAT_FULL},
+};
+
+struct source {
+	char *format;
+	char *file;
+	size_t line;
+	char *func;
+};
+
+// Dictionary of decoded stream indexed by identifiers
+struct dict {
+	struct source *sources;
+	size_t sources_cnt;
+	char **strings;
+	size_t strings_cnt;
+};
+
+static void dict_reset(struct dict *dict) {
+	for (size_t i = 0; i < dict->sources_cnt; i++) {
+		free(dict->sources[i].format);
+		free(dict->sources[i].file);
+		free(dict->sources[i].func);
+	}
+	free(dict->sources);
+	for (size_t i = 0; i < dict->strings_cnt; i++)
+		free(dict->strings[i]);
+	free(dict->strings);
+	*dict = (struct dict){0};
+}
+
+static char *get_str(const char **data, const char *end, bool *ok) {
+	const char *str;
+	size_t len;
+	if (!binary_get_str(data, end, &str, &len)) {
+		*ok = false;
+		return NULL;
+	}
+	return str ? strndup(str, len) : NULL;
+}
+
+// Identifiers are assigned sequentially but some frames might have been dropped.
+// Any bigger gap is considered to be a corruption.
+#define MAX_ID_GAP 65536
+
+// Make space for given identifier in array of given element size
+static void *dict_slot(void *array, size_t *cnt, size_t size, uint64_t id) {
+	if (id >= *cnt) {
+		array = realloc(array, (id + 1) * size);
+		memset((char *)array + *cnt * size, 0, (id + 1 - *cnt) * size);
+		*cnt = id + 1;
+	}
+	return array;
+}
+
+static bool decode_source(struct dict *dict, const char *data, const char *end) {
+	uint64_t id, line;
+	if (!binary_get_uint(&data, end, &id) || id > dict->sources_cnt + MAX_ID_GAP)
+		return false;
+	bool ok = true;
+	struct source source;
+	source.format = get_str(&data, end, &ok);
+	source.file = get_str(&data, end, &ok);
+	ok = ok && binary_get_uint(&data, end, &line);
+	source.line = line;
+	source.func = get_str(&data, end, &ok);
+	if (!ok || source.format == NULL) {
+		free(source.format);
+		free(source.file);
+		free(source.func);
+		return false;
+	}
+	dict->sources = dict_slot(dict->sources, &dict->sources_cnt, sizeof *dict->sources, id);
+	free(dict->sources[id].format);
+	free(dict->sources[id].file);
+	free(dict->sources[id].func);
+	dict->sources[id] = source;
+	return true;
+}
+
+static bool decode_string(struct dict *dict, const char *data, const char *end) {
+	uint64_t id;
+	if (!binary_get_uint(&data, end, &id) || id > dict->strings_cnt + MAX_ID_GAP)
+		return false;
+	bool ok = true;
+	char *str = get_str(&data, end, &ok);
+	if (!ok)
+		return false;
+	dict->strings = dict_slot(dict->strings, &dict->strings_cnt, sizeof *dict->strings, id);
+	free(dict->strings[id]);
+	dict->strings[id] = str;
+	return true;
+}
+
+static const char *dict_string(const struct dict *dict, uint64_t id) {
+	return id < dict->strings_cnt ? dict->strings[id] : NULL;
+}
+
+static bool decode_message(const struct dict *dict, uint64_t second,
+		const struct output *out, const char *data, const char *end) {
+	uint64_t format_id, name_id, err_id, nsec, flags, sample_rate = 1;
+	int64_t level;
+	if (!binary_get_uint(&data, end, &format_id) ||
+			!binary_get_uint(&data, end, &name_id) ||
+			!binary_get_uint(&data, end, &err_id) ||
+			!binary_get_int(&data, end, &level) ||
+			!binary_get_uint(&data, end, &nsec) ||
+			!binary_get_uint(&data, end, &flags) ||
+			(flags & BMF_SAMPLED && !binary_get_uint(&data, end, &sample_rate)))
+		return false;
+	if (format_id >= dict->sources_cnt || dict->sources[format_id].format == NULL) {
+		// Dictionary frame might have been dropped by asynchronous output
+		log_warning(log_decode, "Message with unknown format: %lu", (unsigned long)format_id);
+		return true;
+	}
+	const struct source *source = &dict->sources[format_id];
+	const char *name = dict_string(dict, name_id);
+	const char *err = dict_string(dict, err_id);
+	bool use_origin = flags & BMF_USE_ORIGIN;
+	level = level > LL_CRITICAL ? LL_CRITICAL : level < LL_TRACE ? LL_TRACE : level;
+
+	struct record msg, line;
+	record_init(&msg);
+	record_init(&line);
+	bool ok = binary_render(&msg, source->format, &data, end);
+	if (ok) {
+		unsigned present = (msg.len ? FM_MESSAGE : 0) |
+			(name && *name ? FM_NAME : 0) |
+			(use_origin ? FM_ORIGIN : 0) |
+			(err ? FM_STD_ERR : 0) |
+			(sample_rate > 1 ? FM_SAMPLED : 0);
+		// Only wall clock time is stored
+		struct log_time time = {
+			.have = LT_REAL,
+			.frozen = true,
+			.real = {.tv_sec = second, .tv_nsec = nsec},
+		};
+		render_line(&line, out, level, name, source->file ?: "", source->line,
+				source->func ?: "", NULL, use_origin, present, err, &time,
+				sample_rate > UINT_MAX ? UINT_MAX : sample_rate, msg.data, msg.len);
+		output_write(out, line.data, line.len);
+	}
+	record_free(&msg);
+	record_free(&line);
+	return ok;
+}
+
+// Read single frame. Returns false on the end of file. Size is set to zero if
+// frame is truncated.
+static bool read_frame(FILE *f, char **buf, size_t *bufsiz, size_t *size) {
+	uint64_t len = 0;
+	int c;
+	unsigned shift = 0;
+	do {
+		c = getc(f);
+		if (c == EOF) {
+			*size = 0;
+			return shift != 0;
+		}
+		len |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80 && shift < 64);
+	if (len == 0 || len > SIZE_MAX / 2) {
+		*size = 0;
+		return true;
+	}
+	if (*bufsiz < len) {
+		*buf = realloc(*buf, len);
+		*bufsiz = len;
+	}
+	*size = fread(*buf, 1, len, f) == len ? len : 0;
+	return true;
+}
+
+static bool decode(FILE *f, const char *path, const struct output *out) {
+	struct dict dict = {0};
+	char *buf = NULL;
+	size_t bufsiz = 0, size;
+	bool header = false;
+	uint64_t second = 0;
+	const char *problem = NULL;
+	while (!problem && read_frame(f, &buf, &bufsiz, &size)) {
+		if (size == 0) {
+			problem = "Truncated frame";
+			break;
+		}
+		const char *data = buf + 1, *end = buf + size;
+		if (!header && buf[0] != BF_HEADER) {
+			problem = "Not a LogC binary log";
+			break;
+		}
+		switch (buf[0]) {
+			case BF_HEADER: {
+				uint64_t version;
+				size_t magic_len = strlen(BINARY_MAGIC);
+				if (size <= magic_len || memcmp(data, BINARY_MAGIC, magic_len)) {
+					problem = "Not a LogC binary log";
+					break;
+				}
+				data += magic_len;
+				if (!binary_get_uint(&data, end, &version) || version > BINARY_VERSION) {
+					problem = "Unsupported version";
+					break;
+				}
+				dict_reset(&dict);
+				header = true;
+				break;
+			}
+			case BF_FORMAT:
+				if (!decode_source(&dict, data, end))
+					problem = "Malformed format frame";
+				break;
+			case BF_STRING:
+				if (!decode_string(&dict, data, end))
+					problem = "Malformed string frame";
+				break;
+			case BF_TIME:
+				if (!binary_get_uint(&data, end, &second))
+					problem = "Malformed time frame";
+				break;
+			case BF_MESSAGE:
+				if (!decode_message(&dict, second, out, data, end))
+					problem = "Malformed message frame";
+				break;
+			default:
+				// Unknown frames are skipped for forward compatibility
+				break;
+		}
+	}
+	if (problem)
+		log_error(log_decode, "%s: %s", path, problem);
+	free(buf);
+	dict_reset(&dict);
+	return problem == NULL;
+}
+
+static void usage(FILE *f) {
+	fprintf(f, "Usage: logc-decode [-f FORMAT] [FILE]...\n"
+			"Decode LogC binary log to text. Standard input is used if no FILE is given.\n\n"
+			"  -f FORMAT  Output format: plain, default, full or LogC format string\n"
+			"  -h         Print this help and exit\n");
+}
+
+int main(int argc, char **argv) {
+	const char *format = LOG_FORMAT_DEFAULT;
+	int opt;
+	while ((opt = getopt(argc, argv, "f:h")) != -1) {
+		switch (opt) {
+			case 'f':
+				format = optarg;
+				for (size_t i = 0; i < sizeof named_formats / sizeof *named_formats; i++)
+					if (!strcmp(optarg, named_formats[i].name))
+						format = named_formats[i].format;
+				break;
+			case 'h':
+				usage(stdout);
+				return 0;
+			default:
+				usage(stderr);
+				return 2;
+		}
+	}
+
+	struct output out;
+	new_output(&out, stdout, 0, format, 0);
+	bool ok = true;
+	if (optind == argc)
+		ok = decode(stdin, "-", &out);
+	for (int i = optind; i < argc; i++) {
+		FILE *f = strcmp(argv[i], "-") ? fopen(argv[i], "r") : stdin;
+		if (f == NULL) {
+			log_error(log_decode, "Unable to open %s", argv[i]);
+			ok = false;
+			continue;
+		}
+		ok = decode(f, argv[i], &out) && ok;
+		if (f != stdin)
+			fclose(f);
+	}
+	free_output(&out, false);
+	log_free(log_decode);
+	return ok ? 0 : 1;
+}
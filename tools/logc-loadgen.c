@@ -0,0 +1,674 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright 2022, CZ.NIC z.s.p.o. (http://www.nic.cz/)
+// Load generator: messages are logged from multiple threads and processes at
+// given rate, size and level mix. Latency of logging calls, throughput and CPU
+// usage are reported and output files are read back to find missing and torn
+// lines. Only the public API is used so any output mode can be exercised.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <logc.h>
+
+LOG(loadgen)
+
+// Every generated message starts with this marker followed by process, thread and
+// sequence number and payload terminated by dot.
+#define MARKER "loadgen-msg "
+
+#define MAX_OUTPUTS 16
+
+// Latency histogram with buckets of logarithmic scale divided to linear sub
+// buckets (as HdrHistogram does). Values are recorded with relative error below
+// 1 / HIST_SUB.
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+static const struct {
+	const char *name;
+	const char *format;
+} named_formats[] = {
+	{"plain", LOG_FORMAT_PLAIN},
+	{"default", LOG_FORMAT_DEFAULT},
+	{"full", LOG_FORMAT_FULL},
+};
+
+static const struct {
+	const char *name;
+	enum log_message_level level;
+} levels[] = {
+	{"trace", LL_TRACE},
+	{"debug", LL_DEBUG},
+	{"info", LL_INFO},
+	{"notice", LL_NOTICE},
+	{"warning", LL_WARNING},
+	{"error", LL_ERROR},
+};
+#define LEVELS_CNT (sizeof levels / sizeof *levels)
+
+static const struct {
+	const char *name;
+	int flags;
+} flag_names[] = {
+	{"async", LOG_F_ASYNC},
+	{"drop-newest", LOG_F_ASYNC_DROP_NEWEST},
+	{"drop-oldest", LOG_F_ASYNC_DROP_OLDEST},
+	{"deferred", LOG_F_ASYNC_DEFERRED},
+	{"io_uring", LOG_F_IO_URING},
+	{"buffer", LOG_F_BUFFER},
+	{"buffer-timer", LOG_F_BUFFER_TIMER},
+	{"dedup", LOG_F_DEDUP},
+	{"lock-none", LOG_F_LOCK_NONE},
+	{"lock-mutex", LOG_F_LOCK_MUTEX},
+	{"lock-append", LOG_F_LOCK_APPEND},
+	{"lock-flock", LOG_F_LOCK_FLOCK},
+	{"lock-fcntl", LOG_F_LOCK_FCNTL},
+};
+
+enum kind {
+	K_STREAM, // log_add_output
+	K_FILE, // log_add_file_output
+	K_GZIP, // log_add_compressed_output
+	K_ZSTD,
+	K_MMAP, // log_add_mmap_output
+	K_BINARY, // log_add_binary_output
+	K_NULL, // log_add_output to /dev/null
+	K_SYSLOG, // log_syslog_format
+};
+
+static const struct {
+	const char *name;
+	bool path; // requires path
+	bool verify; // lines can be read back
+	bool shared; // can be shared by forked processes
+} kinds[] = {
+	[K_STREAM] = {"stream", true, true, true},
+	[K_FILE] = {"file", true, true, true},
+	[K_GZIP] = {"gzip", true, false, false},
+	[K_ZSTD] = {"zstd", true, false, false},
+	[K_MMAP] = {"mmap", true, true, true},
+	[K_BINARY] = {"binary", true, false, false},
+	[K_NULL] = {"null", false, false, true},
+	[K_SYSLOG] = {"syslog", false, false, true},
+};
+
+struct output {
+	const char *spec;
+	enum kind kind;
+	char *path;
+	int flags;
+	FILE *f;
+};
+
+struct config {
+	unsigned processes, threads;
+	double duration; // in seconds, used if count is zero
+	uint64_t count; // messages per thread
+	double rate; // messages per second per thread, zero for unlimited
+	size_t size; // size of payload
+	unsigned weights[LEVELS_CNT];
+	unsigned weights_sum;
+	const char *format;
+	struct output outs[MAX_OUTPUTS];
+	size_t outs_cnt;
+};
+
+// Statistics of single writer thread. These are placed in shared memory so forked
+// processes can report them.
+struct writer {
+	uint64_t sent; // messages passed to logc
+	uint64_t logged; // messages that passed verbosity (with sequence number)
+	uint64_t start, end; // monotonic time in nanoseconds
+	uint64_t hist[HIST_BUCKETS];
+};
+
+struct shared {
+	struct writer *writers; // processes * threads
+	size_t *dropped; // processes * MAX_OUTPUTS
+	size_t size;
+};
+
+struct thread {
+	const struct config *conf;
+	struct writer *w;
+	unsigned proc, thread;
+	pthread_t tid;
+};
+
+
+static size_t hist_index(uint64_t v) {
+	if (v < HIST_SUB)
+		return v;
+	unsigned e = 63 - __builtin_clzll(v);
+	return (e - HIST_SUB_BITS + 1) * HIST_SUB + ((v >> (e - HIST_SUB_BITS)) - HIST_SUB);
+}
+
+// The lowest value of given bucket
+static uint64_t hist_value(size_t i) {
+	if (i < HIST_SUB)
+		return i;
+	unsigned g = i / HIST_SUB;
+	return (uint64_t)(i % HIST_SUB + HIST_SUB) << (g - 1);
+}
+
+static uint64_t hist_percentile(const uint64_t *hist, uint64_t total, double p) {
+	uint64_t rank = p / 100 * total;
+	if (rank >= total)
+		rank = total - 1;
+	uint64_t cnt = 0;
+	for (size_t i = 0; i < HIST_BUCKETS; i++)
+		if ((cnt += hist[i]) > rank)
+			return hist_value(i);
+	return 0;
+}
+
+static uint64_t now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t) {
+	struct timespec ts = {.tv_sec = t / 1000000000ULL, .tv_nsec = t % 1000000000ULL};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+// Cheap per thread pseudo random generator (xorshift64)
+static uint64_t next_random(uint64_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+static enum log_message_level pick_level(const struct config *conf, uint64_t *rng) {
+	unsigned r = next_random(rng) % conf->weights_sum;
+	for (size_t i = 0; i < LEVELS_CNT; i++) {
+		if (r < conf->weights[i])
+			return levels[i].level;
+		r -= conf->weights[i];
+	}
+	return LL_NOTICE;
+}
+
+static char payload_char(uint64_t seq) {
+	return 'a' + seq % 26;
+}
+
+static void *writer_thread(void *arg) {
+	struct thread *t = arg;
+	const struct config *conf = t->conf;
+	struct writer *w = t->w;
+	uint64_t rng = 0x9e3779b97f4a7c15ULL * (t->proc * conf->threads + t->thread + 1);
+	char *payload = malloc(conf->size + 1);
+	payload[conf->size] = '\0';
+
+	w->start = now();
+	uint64_t deadline = w->start + conf->duration * 1e9;
+	uint64_t interval = conf->rate > 0 ? 1e9 / conf->rate : 0;
+	for (uint64_t i = 0; conf->count ? i < conf->count : now() < deadline; i++) {
+		enum log_message_level level = pick_level(conf, &rng);
+		// Only messages that are outputted get sequence number so the expected
+		// ones form continuous range
+		uint64_t seq = log_would_log(log_loadgen, level) ? w->logged++ : UINT64_MAX;
+		memset(payload, payload_char(seq), conf->size);
+		if (interval)
+			sleep_until(w->start + i * interval);
+		uint64_t start = now();
+		logc(log_loadgen, level, MARKER "%u %u %" PRIu64 " %s.", t->proc, t->thread,
+				seq, payload);
+		w->hist[hist_index(now() - start)]++;
+		w->sent++;
+	}
+	w->end = now();
+	free(payload);
+	return NULL;
+}
+
+static void run_process(const struct config *conf, struct shared *sh, unsigned proc) {
+	struct thread *threads = calloc(conf->threads, sizeof *threads);
+	for (unsigned i = 0; i < conf->threads; i++) {
+		threads[i] = (struct thread){
+			.conf = conf,
+			.w = &sh->writers[proc * conf->threads + i],
+			.proc = proc,
+			.thread = i,
+		};
+		int err = pthread_create(&threads[i].tid, NULL, writer_thread, &threads[i]);
+		if (err) {
+			fprintf(stderr, "Unable to create thread: %s\n", strerror(err));
+			exit(1);
+		}
+	}
+	for (unsigned i = 0; i < conf->threads; i++)
+		pthread_join(threads[i].tid, NULL);
+	free(threads);
+	log_flush(log_loadgen);
+	for (size_t i = 0; i < conf->outs_cnt; i++)
+		if (conf->outs[i].f)
+			sh->dropped[proc * MAX_OUTPUTS + i] =
+				log_output_dropped(log_loadgen, conf->outs[i].f);
+}
+
+
+static bool parse_output(struct output *out, char *spec) {
+	out->spec = strdup(spec);
+	char *saveptr;
+	char *kind = strtok_r(spec, ":", &saveptr);
+	size_t k;
+	for (k = 0; k < sizeof kinds / sizeof *kinds; k++)
+		if (kind && !strcmp(kind, kinds[k].name))
+			break;
+	if (k == sizeof kinds / sizeof *kinds) {
+		fprintf(stderr, "Unknown output: %s\n", out->spec);
+		return false;
+	}
+	out->kind = k;
+	if (kinds[k].path) {
+		char *path = strtok_r(NULL, ":", &saveptr);
+		if (path == NULL) {
+			fprintf(stderr, "Output requires path: %s\n", out->spec);
+			return false;
+		}
+		out->path = strdup(path);
+	}
+	char *flags = strtok_r(NULL, ":", &saveptr);
+	for (char *flag = flags ? strtok_r(flags, ",", &saveptr) : NULL; flag;
+			flag = strtok_r(NULL, ",", &saveptr)) {
+		size_t i;
+		for (i = 0; i < sizeof flag_names / sizeof *flag_names; i++)
+			if (!strcmp(flag, flag_names[i].name))
+				break;
+		if (i == sizeof flag_names / sizeof *flag_names) {
+			fprintf(stderr, "Unknown flag %s of output: %s\n", flag, out->spec);
+			return false;
+		}
+		out->flags |= flag_names[i].flags;
+	}
+	return true;
+}
+
+static bool parse_levels(struct config *conf, char *mix) {
+	memset(conf->weights, 0, sizeof conf->weights);
+	conf->weights_sum = 0;
+	char *saveptr;
+	for (char *item = strtok_r(mix, ",", &saveptr); item;
+			item = strtok_r(NULL, ",", &saveptr)) {
+		char *weight = strchr(item, '=');
+		if (weight)
+			*weight++ = '\0';
+		size_t i;
+		for (i = 0; i < LEVELS_CNT; i++)
+			if (!strcmp(item, levels[i].name))
+				break;
+		if (i == LEVELS_CNT) {
+			fprintf(stderr, "Unknown level: %s\n", item);
+			return false;
+		}
+		conf->weights[i] += weight ? atoi(weight) : 1;
+		conf->weights_sum += weight ? atoi(weight) : 1;
+	}
+	if (conf->weights_sum == 0) {
+		fprintf(stderr, "Level mix has no weight\n");
+		return false;
+	}
+	return true;
+}
+
+static int parse_level(const char *name) {
+	for (size_t i = 0; i < LEVELS_CNT; i++)
+		if (!strcmp(name, levels[i].name))
+			return levels[i].level;
+	return atoi(name);
+}
+
+static bool add_output(struct config *conf, struct output *out) {
+	if (out->path && unlink(out->path) && errno != ENOENT) {
+		fprintf(stderr, "Unable to remove %s: %s\n", out->path, strerror(errno));
+		return false;
+	}
+	errno = 0;
+	switch (out->kind) {
+		case K_STREAM:
+		case K_BINARY:
+		case K_NULL:
+			out->f = fopen(out->path ?: "/dev/null", "a");
+			if (out->f == NULL)
+				break;
+			if (out->kind == K_BINARY)
+				log_add_binary_output(log_loadgen, out->f, out->flags | LOG_F_AUTOCLOSE, 0);
+			else
+				log_add_output(log_loadgen, out->f, out->flags | LOG_F_AUTOCLOSE, 0,
+						conf->format);
+			break;
+		case K_FILE:
+			out->f = log_add_file_output(log_loadgen, out->path, out->flags, 0,
+					conf->format, NULL);
+			break;
+		case K_GZIP:
+		case K_ZSTD:
+			out->f = log_add_compressed_output(log_loadgen, out->path, out->flags, 0,
+					conf->format, &(struct log_compression){
+						.codec = out->kind == K_GZIP ? LOG_CODEC_GZIP : LOG_CODEC_ZSTD,
+					});
+			break;
+		case K_MMAP:
+			out->f = log_add_mmap_output(log_loadgen, out->path, out->flags, 0,
+					conf->format, NULL);
+			break;
+		case K_SYSLOG:
+			log_syslog_format(log_loadgen, conf->format);
+			return true;
+	}
+	if (out->f == NULL) {
+		fprintf(stderr, "Unable to add output %s: %s\n", out->spec, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+
+struct verify {
+	uint64_t lines, missing, duplicate, torn, unrecognized;
+};
+
+// Read output file back and check every line generated by writers. Writer's
+// lines have to have sequence numbers from zero up to number of logged messages.
+static bool verify_output(const struct config *conf, const struct shared *sh,
+		const char *path, struct verify *res) {
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	size_t writers_cnt = conf->processes * conf->threads;
+	uint8_t **seen = calloc(writers_cnt, sizeof *seen);
+	for (size_t i = 0; i < writers_cnt; i++)
+		seen[i] = calloc(sh->writers[i].logged / 8 + 1, 1);
+
+	*res = (struct verify){0};
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+	while ((len = getline(&line, &size, f)) != -1) {
+		res->lines++;
+		const char *msg = strstr(line, MARKER);
+		if (msg == NULL) {
+			res->unrecognized++;
+			continue;
+		}
+		unsigned proc, thread;
+		uint64_t seq;
+		int payload;
+		if (sscanf(msg + strlen(MARKER), "%u %u %" SCNu64 " %n", &proc, &thread, &seq,
+					&payload) != 3 || proc >= conf->processes ||
+				thread >= conf->threads) {
+			res->torn++;
+			continue;
+		}
+		size_t w = proc * conf->threads + thread;
+		const char *data = msg + strlen(MARKER) + payload;
+		bool valid = seq < sh->writers[w].logged &&
+			line + len - data > (ssize_t)conf->size && data[conf->size] == '.';
+		for (size_t i = 0; valid && i < conf->size; i++)
+			valid = data[i] == payload_char(seq);
+		if (!valid) {
+			res->torn++;
+			continue;
+		}
+		if (seen[w][seq / 8] & (1 << seq % 8))
+			res->duplicate++;
+		seen[w][seq / 8] |= 1 << seq % 8;
+	}
+	free(line);
+	fclose(f);
+
+	for (size_t w = 0; w < writers_cnt; w++) {
+		for (uint64_t seq = 0; seq < sh->writers[w].logged; seq++)
+			if (!(seen[w][seq / 8] & (1 << seq % 8)))
+				res->missing++;
+		free(seen[w]);
+	}
+	free(seen);
+	return true;
+}
+
+static void *shared_alloc(size_t size) {
+	void *res = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+			-1, 0);
+	if (res == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	return res;
+}
+
+static double timeval_sec(struct timeval tv) {
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static bool report(const struct config *conf, const struct shared *sh, double wall,
+		const struct rusage *usage) {
+	size_t writers_cnt = conf->processes * conf->threads;
+	uint64_t *hist = calloc(HIST_BUCKETS, sizeof *hist);
+	uint64_t sent = 0, logged = 0, start = UINT64_MAX, end = 0;
+	for (size_t w = 0; w < writers_cnt; w++) {
+		const struct writer *wr = &sh->writers[w];
+		sent += wr->sent;
+		logged += wr->logged;
+		if (wr->start < start)
+			start = wr->start;
+		if (wr->end > end)
+			end = wr->end;
+		for (size_t i = 0; i < HIST_BUCKETS; i++)
+			hist[i] += wr->hist[i];
+	}
+	double elapsed = end > start ? (end - start) / 1e9 : 0;
+
+	printf("writers: %u processes x %u threads, %.3f s\n", conf->processes,
+			conf->threads, elapsed);
+	printf("messages: %" PRIu64 " sent, %" PRIu64 " logged, %.0f msg/s\n", sent, logged,
+			elapsed > 0 ? sent / elapsed : 0);
+	if (sent) {
+		printf("latency (ns): min %" PRIu64, hist_percentile(hist, sent, 0));
+		static const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+		for (size_t i = 0; i < sizeof percentiles / sizeof *percentiles; i++)
+			printf(", p%g %" PRIu64, percentiles[i],
+					hist_percentile(hist, sent, percentiles[i]));
+		printf(", max %" PRIu64 "\n", hist_percentile(hist, sent, 100));
+	}
+	double user = timeval_sec(usage->ru_utime), sys = timeval_sec(usage->ru_stime);
+	printf("cpu: user %.3f s, system %.3f s, %.1f %% of wall time %.3f s\n", user, sys,
+			wall > 0 ? 100 * (user + sys) / wall : 0, wall);
+	free(hist);
+
+	bool ok = true;
+	for (size_t i = 0; i < conf->outs_cnt; i++) {
+		const struct output *out = &conf->outs[i];
+		// Memory mapped output counts drops of all processes
+		size_t dropped = 0;
+		for (unsigned p = 0; p < conf->processes; p++) {
+			size_t d = sh->dropped[p * MAX_OUTPUTS + i];
+			if (out->kind != K_MMAP)
+				dropped += d;
+			else if (d > dropped)
+				dropped = d;
+		}
+		printf("output %s: dropped %zu", out->spec, dropped);
+		struct verify v;
+		if (!kinds[out->kind].verify) {
+			printf(", not verified\n");
+		} else if (verify_output(conf, sh, out->path, &v)) {
+			printf(", lines %" PRIu64 ", missing %" PRIu64 ", duplicate %" PRIu64
+					", torn %" PRIu64 ", unrecognized %" PRIu64 "\n", v.lines,
+					v.missing, v.duplicate, v.torn, v.unrecognized);
+			ok = ok && v.missing == dropped && !v.duplicate && !v.torn;
+		} else {
+			printf("\n");
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+
+static void usage(FILE *f) {
+	fprintf(f, "Usage: logc-loadgen [OPTION]... -o OUTPUT...\n");
+	fprintf(f, "Generate log messages from multiple threads and processes and report\n");
+	fprintf(f, "latency, throughput, CPU usage and missing or torn lines.\n\n");
+	fprintf(f, "  -p PROCESSES  Number of forked processes (default 1, in process)\n");
+	fprintf(f, "  -t THREADS    Number of threads in every process (default 1)\n");
+	fprintf(f, "  -d SECONDS    Duration of load (default 5)\n");
+	fprintf(f, "  -n COUNT      Number of messages of every thread instead of duration\n");
+	fprintf(f, "  -r RATE       Messages per second of every thread (default unlimited)\n");
+	fprintf(f, "  -s SIZE       Size of message payload in bytes (default 64)\n");
+	fprintf(f, "  -l MIX        Level mix as LEVEL[=WEIGHT],... (default notice)\n");
+	fprintf(f, "  -v LEVEL      Verbosity of log (default notice)\n");
+	fprintf(f, "  -f FORMAT     Format of outputs or plain, default or full (default plain)\n");
+	fprintf(f, "  -o OUTPUT     Output as KIND[:PATH][:FLAG,...] (can be repeated)\n");
+	fprintf(f, "  -h            Print this help and exit\n\n");
+	fprintf(f, "Kinds: stream, file, gzip, zstd, mmap and binary (with path), null and\n");
+	fprintf(f, "syslog. Files are replaced. Flags: async, drop-newest, drop-oldest,\n");
+	fprintf(f, "deferred, io_uring, buffer, buffer-timer, dedup and lock-none, lock-mutex,\n");
+	fprintf(f, "lock-append, lock-flock or lock-fcntl.\n");
+}
+
+int main(int argc, char **argv) {
+	struct config conf = {
+		.processes = 1,
+		.threads = 1,
+		.duration = 5,
+		.size = 64,
+		.format = LOG_FORMAT_PLAIN,
+	};
+	char default_mix[] = "notice";
+	parse_levels(&conf, default_mix);
+	int verbosity = LL_NOTICE;
+	int opt;
+	while ((opt = getopt(argc, argv, "p:t:d:n:r:s:l:v:f:o:h")) != -1) {
+		switch (opt) {
+			case 'p':
+				conf.processes = atoi(optarg);
+				break;
+			case 't':
+				conf.threads = atoi(optarg);
+				break;
+			case 'd':
+				conf.duration = atof(optarg);
+				break;
+			case 'n':
+				conf.count = strtoull(optarg, NULL, 10);
+				break;
+			case 'r':
+				conf.rate = atof(optarg);
+				break;
+			case 's':
+				conf.size = strtoul(optarg, NULL, 10);
+				break;
+			case 'l':
+				if (!parse_levels(&conf, optarg))
+					return 2;
+				break;
+			case 'v':
+				verbosity = parse_level(optarg);
+				break;
+			case 'f':
+				conf.format = optarg;
+				for (size_t i = 0; i < sizeof named_formats / sizeof *named_formats; i++)
+					if (!strcmp(optarg, named_formats[i].name))
+						conf.format = named_formats[i].format;
+				break;
+			case 'o':
+				if (conf.outs_cnt == MAX_OUTPUTS) {
+					fprintf(stderr, "Too many outputs\n");
+					return 2;
+				}
+				if (!parse_output(&conf.outs[conf.outs_cnt++], optarg))
+					return 2;
+				break;
+			case 'h':
+				usage(stdout);
+				return 0;
+			default:
+				usage(stderr);
+				return 2;
+		}
+	}
+	if (optind != argc || conf.processes == 0 || conf.threads == 0 ||
+			conf.outs_cnt == 0) {
+		usage(stderr);
+		return 2;
+	}
+	for (size_t i = 0; i < conf.outs_cnt; i++)
+		if (conf.processes > 1 && !kinds[conf.outs[i].kind].shared) {
+			fprintf(stderr, "Output %s can't be shared by processes\n", conf.outs[i].spec);
+			return 2;
+		}
+
+	log_set_level(log_loadgen, verbosity);
+	log_stderr_fallback(log_loadgen, false);
+	for (size_t i = 0; i < conf.outs_cnt; i++)
+		if (!add_output(&conf, &conf.outs[i]))
+			return 1;
+
+	size_t writers_cnt = conf.processes * conf.threads;
+	struct shared sh = {
+		.size = writers_cnt * sizeof *sh.writers +
+			conf.processes * MAX_OUTPUTS * sizeof *sh.dropped,
+	};
+	sh.writers = shared_alloc(sh.size);
+	sh.dropped = (size_t *)(sh.writers + writers_cnt);
+
+	uint64_t start = now();
+	if (conf.processes == 1) {
+		run_process(&conf, &sh, 0);
+	} else {
+		for (unsigned p = 0; p < conf.processes; p++) {
+			pid_t pid = fork();
+			if (pid == -1) {
+				perror("fork");
+				return 1;
+			}
+			if (pid == 0) {
+				run_process(&conf, &sh, p);
+				log_free(log_loadgen);
+				exit(0);
+			}
+		}
+		int status;
+		bool failed = false;
+		while (wait(&status) != -1)
+			failed = failed || !WIFEXITED(status) || WEXITSTATUS(status);
+		if (failed) {
+			fprintf(stderr, "Writer process failed\n");
+			return 1;
+		}
+	}
+	log_free(log_loadgen); // writes out and closes all outputs
+	double wall = (now() - start) / 1e9;
+
+	struct rusage usage, children;
+	getrusage(RUSAGE_SELF, &usage);
+	getrusage(RUSAGE_CHILDREN, &children);
+	usage.ru_utime.tv_sec += children.ru_utime.tv_sec;
+	usage.ru_utime.tv_usec += children.ru_utime.tv_usec;
+	usage.ru_stime.tv_sec += children.ru_stime.tv_sec;
+	usage.ru_stime.tv_usec += children.ru_stime.tv_usec;
+
+	bool ok = report(&conf, &sh, wall, &usage);
+
+	munmap(sh.writers, sh.size);
+	for (size_t i = 0; i < conf.outs_cnt; i++) {
+		free((char *)conf.outs[i].spec);
+		free(conf.outs[i].path);
+	}
+	return ok ? 0 : 1;
+}